@@ -0,0 +1,760 @@
+//
+// Bounding volume hierarchy over the faces of a TriMesh, for view frustum culling, ray casting and nearest
+// point queries.
+// The tree is built top down with the surface area heuristic evaluated over kBins bins of the face
+// centroids per axis.  Large nodes are binned in parallel and their subtrees are built on threads of their
+// own.  The nodes are stored depth first in one array of 32 byte nodes, so the left child of a node is the
+// next one, and the faces of every subtree are a contiguous range of the face order.
+// Positions and triangles are copied from the mesh in that order, the mesh is only read while building.
+//
+
+#ifndef LEOYOLO_BVH_H
+#define LEOYOLO_BVH_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "common.h"
+#include "TriMesh.h"
+
+class BVH {
+public:
+    static constexpr int kBins = 16;
+    static constexpr int kMaxLeafFaces = 8;
+    // Cost of visiting a node relative to a triangle test.  Larger leaves also made the ray and nearest
+    // point queries faster on the test meshes, and the tree smaller.
+    static constexpr float kTraversalCost = 3.f;
+    // Below this depth the faces are split at their median instead, which bounds the depth of the tree.
+    static constexpr int kMaxSahDepth = 32;
+    static constexpr int kMaxDepth = 64;
+    // Nodes with fewer faces are binned by one thread, and split into subtrees built by one thread.
+    static constexpr int kParallelFaces = 1 << 16;
+    // Subtrees of at least this many faces poll the progress callback of the build.
+    static constexpr int kProgressFaces = 1 << 14;
+
+    // Internal nodes have the next node as left child and nodes[index] as right child.
+    struct Node {
+        float bmin[3];
+        int index;      // first face of a leaf in the face order, right child of an internal node
+        float bmax[3];
+        int count;      // number of faces of a leaf, 0 for an internal node
+
+        bool IsLeaf() const { return count > 0; }
+    };
+
+    struct Stats {
+        int nodes;
+        int leaves;
+        int depth;
+        double sah_cost;        // expected node visits and triangle tests of a ray through the root box
+        double build_seconds;   // wall time
+        std::size_t bytes;      // nodes, face order, triangles and positions
+    };
+
+    struct RayHit {
+        int face;       // position in the face list of the mesh, -1 for no hit
+        float t;        // the hit is at origin + t dir
+        float u, v;     // barycentric coordinates of corners 1 and 2 of the face in the corner table
+    };
+
+    struct NearestPoint {
+        int face;       // -1 for none within the search distance
+        float point[3];
+        float distance;
+    };
+
+    // Build over all faces of `mesh` on `num_threads` threads (0 for NumThreads()).  `progress` gets the
+    // fraction of faces placed in the tree, from the building threads but never concurrently.  If it returns
+    // false the build stops, and the tree is left empty, see IsCanceled.
+    explicit BVH(TriMesh &mesh, int num_threads = 0, const ProgressCallback &progress = ProgressCallback());
+
+    bool IsCanceled() const { return m_canceled; }
+
+    std::size_t NumFaces() const { return m_faces.size(); }
+    const std::vector<Node> &Nodes() const { return m_nodes; }
+    // Face list positions in the order of the leaves.
+    const std::vector<int> &Faces() const { return m_faces; }
+    const Stats &GetStats() const { return m_stats; }
+
+    // Take the positions of `mesh` again and update the boxes without changing the tree, e.g. after vertices
+    // moved.  The mesh must have the faces the tree was built for.
+    void Refit(TriMesh &mesh, int num_threads = 0);
+
+    // Planes a x + b y + c z + d >= 0 of the view frustum of the column major clip matrix `m` (projection
+    // times modelview).  Points inside the frustum are on the positive side of all six.
+    static void FrustumPlanes(const float m[16], float planes[6][4]);
+
+    // Ranges (first, count) of the face order whose boxes are not outside one of `planes`, increasing and
+    // with adjacent ranges merged.  Return the number of faces in them.
+    std::size_t CullFrustum(const float planes[6][4], std::vector<std::pair<int, int>> &ranges) const;
+
+    // Closest intersection of the ray origin + t dir with 0 <= t < t_max, with either side of the faces.
+    bool Intersect(const float origin[3], const float dir[3], RayHit &hit, float t_max = FLT_MAX) const;
+
+    // Closest point of the surface to `p` within `max_distance`.
+    bool Nearest(const float p[3], NearestPoint &result, float max_distance = FLT_MAX) const;
+
+private:
+    struct Box {
+        float bmin[3], bmax[3];
+
+        Box() { Reset(); }
+        void Reset() {
+            for (int a = 0; a < 3; ++a) {
+                bmin[a] = FLT_MAX;
+                bmax[a] = -FLT_MAX;
+            }
+        }
+        void Grow(const float lo[3], const float hi[3]) {
+            for (int a = 0; a < 3; ++a) {
+                bmin[a] = MIN(bmin[a], lo[a]);
+                bmax[a] = MAX(bmax[a], hi[a]);
+            }
+        }
+        void Grow(const Box &b) { Grow(b.bmin, b.bmax); }
+        float Area() const {
+            const float dx = bmax[0] - bmin[0], dy = bmax[1] - bmin[1], dz = bmax[2] - bmin[2];
+            return (dx < 0.f) ? 0.f : 2.f * (dx*dy + dy*dz + dz*dx);
+        }
+    };
+
+    // A face while building, moved around by the partitions.
+    struct Ref {
+        float bmin[3], bmax[3];
+        int face;
+
+        float Centroid(int axis) const { return 0.5f * (bmin[axis] + bmax[axis]); }
+    };
+
+    struct Bin {
+        Box bounds, centroids;
+        int count;
+
+        void Reset() {
+            bounds.Reset();
+            centroids.Reset();
+            count = 0;
+        }
+    };
+
+    // Faces refs[first, first+count) with `bounds` and centroid bounds `centroids`.
+    struct Range {
+        int first, count;
+        Box bounds, centroids;
+    };
+
+    struct Split {
+        int num_bins;       // per axis, fewer than kBins for small nodes
+        int axis, bin;      // faces in bins below `bin` go left; axis -1 for none
+        float cost;
+        Range left, right;
+    };
+
+    // Bin of a centroid coordinate `c` out of `num_bins` over a centroid box starting at `start`.
+    static float BinScale(const Box &centroids, int axis, int num_bins) {
+        return float(num_bins) / (centroids.bmax[axis] - centroids.bmin[axis]);
+    }
+    static int BinOf(float c, float start, float scale, int num_bins) {
+        const int b = int((c - start) * scale);
+        return MIN(MAX(b, 0), num_bins - 1);
+    }
+
+    // Progress shared by the threads building one tree.
+    struct BuildProgress {
+        const ProgressCallback *callback;
+        int total_faces;
+        std::atomic<int> faces_done;
+        std::atomic<bool> canceled;
+        std::mutex report_mutex;    // the callback is never invoked concurrently
+
+        BuildProgress(const ProgressCallback *cb, int total)
+            : callback(cb), total_faces(total), faces_done(0), canceled(false) {}
+
+        // Account for `faces` more faces in finished subtrees.  Return false if the build should stop.
+        bool Advance(int faces) {
+            const int done = faces_done.fetch_add(faces) + faces;
+            if (callback && *callback && report_mutex.try_lock()) {
+                if (!(*callback)(float(done) / float(MAX(total_faces, 1)))) canceled = true;
+                report_mutex.unlock();
+            }
+            return !canceled;
+        }
+    };
+
+    void Build(std::vector<Ref> &refs, const Range &range, int depth, int threads, BuildProgress &progress,
+               std::vector<Node> &out) const;
+    Split FindSplit(const std::vector<Ref> &refs, const Range &range, int threads) const;
+    void SplitMedian(std::vector<Ref> &refs, const Range &range, Range &left, Range &right) const;
+    static void MakeRange(const std::vector<Ref> &refs, int first, int count, Range &range);
+    static void Append(std::vector<Node> &out, const std::vector<Node> &sub);
+    void ComputeStats();
+    void CopyPositions(TriMesh &mesh, int threads);
+
+    // First and last faces of the subtree at `i`, as a range (first, count).
+    std::pair<int, int> SubtreeFaces(int i) const;
+
+    bool IntersectBox(const Node &node, const float origin[3], const float inv_dir[3], float t_max, float &t) const;
+    bool IntersectTriangle(int k, const float origin[3], const float dir[3], float &t, float &u, float &v) const;
+    float ClosestPoint(int k, const float p[3], float q[3]) const;
+    static float BoxDistance2(const Node &node, const float p[3]);
+
+private:
+    std::vector<Node> m_nodes;
+    std::vector<int> m_faces;       // face list positions in leaf order
+    std::vector<int> m_tris;        // vertex positions of the corners, in leaf order
+    std::vector<float> m_positions; // x, y, z per vertex
+    Stats m_stats;
+    bool m_canceled;
+};
+
+// Faces are binned by their box centroids; the children boxes come out of the bins, so every node is swept once.
+inline BVH::BVH(TriMesh &mesh, int num_threads, const ProgressCallback &progress) : m_canceled(false) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<int> &tri = mesh.GetTriangles();
+    const int num_faces = int(tri.size() / 3);
+    const int threads = MIN<int>(NumThreads(num_threads), num_faces / kParallelFaces + 1);
+    CopyPositions(mesh, threads);
+
+    std::vector<Ref> refs(num_faces);
+    std::vector<Box> bounds(threads), centroids(threads);
+    ParallelFor(0, num_faces, [&](std::size_t b, std::size_t e, int t) {
+        for (std::size_t f = b; f < e; ++f) {
+            Ref &ref = refs[f];
+            const float *p = &m_positions[3 * tri[3*f]];
+            for (int a = 0; a < 3; ++a) ref.bmin[a] = ref.bmax[a] = p[a];
+            for (int c = 1; c < 3; ++c) {
+                p = &m_positions[3 * tri[3*f + c]];
+                for (int a = 0; a < 3; ++a) {
+                    ref.bmin[a] = MIN(ref.bmin[a], p[a]);
+                    ref.bmax[a] = MAX(ref.bmax[a], p[a]);
+                }
+            }
+            ref.face = int(f);
+            bounds[t].Grow(ref.bmin, ref.bmax);
+            const float c[3] = {ref.Centroid(0), ref.Centroid(1), ref.Centroid(2)};
+            centroids[t].Grow(c, c);
+        }
+    }, threads);
+
+    m_nodes.clear();
+    if (num_faces > 0) {
+        Range root = {0, num_faces, Box(), Box()};
+        for (int t = 0; t < threads; ++t) {
+            root.bounds.Grow(bounds[t]);
+            root.centroids.Grow(centroids[t]);
+        }
+        m_nodes.reserve(2 * (num_faces / 2 + 1));
+        BuildProgress build_progress(&progress, num_faces);
+        Build(refs, root, 0, threads, build_progress, m_nodes);
+        if (build_progress.canceled) {
+            m_canceled = true;
+            m_nodes.clear();
+            m_positions.clear();
+            ComputeStats();
+            m_stats.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return;
+        }
+    }
+
+    m_faces.resize(num_faces);
+    m_tris.resize(3 * std::size_t(num_faces));
+    ParallelFor(0, num_faces, [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t k = b; k < e; ++k) {
+            const int f = refs[k].face;
+            m_faces[k] = f;
+            for (int c = 0; c < 3; ++c) m_tris[3*k + c] = tri[3*f + c];
+        }
+    }, threads);
+    ComputeStats();
+    m_stats.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (progress) progress(1.f);
+}
+
+inline void BVH::CopyPositions(TriMesh &mesh, int threads) {
+    const std::size_t num_verts = mesh.NumVertices();
+    m_positions.resize(3 * num_verts);
+    ParallelFor(0, num_verts, [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t i = b; i < e; ++i) {
+            const HE_vert *v = mesh.GetVertex(i);
+            m_positions[3*i] = v->x;
+            m_positions[3*i + 1] = v->y;
+            m_positions[3*i + 2] = v->z;
+        }
+    }, threads);
+}
+
+// Append the node of `range` and its subtree to `out`.  With more than one thread, a split whose both
+// sides are large builds its left subtree on a new thread, each side into its own array.
+// Large subtrees poll `progress` first and stop as a leaf once the build is canceled.
+inline void BVH::Build(std::vector<Ref> &refs, const Range &range, int depth, int threads,
+                       BuildProgress &progress, std::vector<Node> &out) const {
+    const int self = int(out.size());
+    out.push_back(Node());
+    for (int a = 0; a < 3; ++a) {
+        out[self].bmin[a] = range.bounds.bmin[a];
+        out[self].bmax[a] = range.bounds.bmax[a];
+    }
+    out[self].index = range.first;
+    out[self].count = range.count;
+    if (range.count <= 1) return;
+    const bool polls = range.count >= kProgressFaces;
+    if (polls && !progress.Advance(0)) return;
+
+    Split split;
+    split.axis = -1;
+    if (depth >= kMaxSahDepth && range.count <= kMaxLeafFaces) return;
+    if (depth < kMaxSahDepth) {
+        split = FindSplit(refs, range, range.count >= kParallelFaces ? threads : 1);
+        if (split.axis < 0 && range.count <= kMaxLeafFaces) return;    // coincident centroids
+        if (split.axis >= 0 && range.count <= kMaxLeafFaces && split.cost >= float(range.count)) return;
+    }
+    if (split.axis >= 0) {
+        const int axis = split.axis;
+        const int num_bins = split.num_bins;
+        const float start = range.centroids.bmin[axis], scale = BinScale(range.centroids, axis, num_bins);
+        auto goes_left = [&](const Ref &ref) { return BinOf(ref.Centroid(axis), start, scale, num_bins) < split.bin; };
+        auto mid = std::partition(refs.begin() + range.first, refs.begin() + range.first + range.count, goes_left);
+        const int left_count = int(mid - refs.begin()) - range.first;
+        if (left_count != split.left.count) {   // a centroid rounded into another bin
+            MakeRange(refs, range.first, left_count, split.left);
+            MakeRange(refs, range.first + left_count, range.count - left_count, split.right);
+        }
+    }
+    if (split.axis < 0 || split.left.count == 0 || split.right.count == 0) {
+        SplitMedian(refs, range, split.left, split.right);
+    }
+
+    out[self].count = 0;
+    // the faces of the children below kProgressFaces count as done once their subtree is built
+    auto build_child = [&](const Range &child, int child_threads, std::vector<Node> &child_out) {
+        Build(refs, child, depth + 1, child_threads, progress, child_out);
+        if (polls && child.count < kProgressFaces) progress.Advance(child.count);
+    };
+    if (threads > 1 && MIN(split.left.count, split.right.count) >= kParallelFaces) {
+        std::vector<Node> left, right;
+        const int left_threads = threads / 2;
+        std::thread worker([&]() { build_child(split.left, left_threads, left); });
+        build_child(split.right, threads - left_threads, right);
+        worker.join();
+        Append(out, left);
+        out[self].index = int(out.size());
+        Append(out, right);
+    } else {
+        build_child(split.left, threads, out);
+        out[self].index = int(out.size());
+        build_child(split.right, threads, out);
+    }
+}
+
+// The children of a node in `sub` keep their place relative to it.
+inline void BVH::Append(std::vector<Node> &out, const std::vector<Node> &sub) {
+    const int offset = int(out.size());
+    out.insert(out.end(), sub.begin(), sub.end());
+    for (std::size_t i = offset; i < out.size(); ++i) {
+        if (!out[i].IsLeaf()) out[i].index += offset;
+    }
+}
+
+// Cheapest split between bins over the three axes, cost relative to a triangle test.  A node gets as many
+// bins as it has faces, up to kBins.
+inline BVH::Split BVH::FindSplit(const std::vector<Ref> &refs, const Range &range, int threads) const {
+    const int num_bins = MIN(range.count, int(kBins));
+    Bin bins[3 * kBins];
+    std::vector<Bin> more_bins(3 * num_bins * (threads - 1));     // of the other threads
+    for (int i = 0; i < 3 * num_bins; ++i) bins[i].Reset();
+    for (Bin &bin : more_bins) bin.Reset();
+    bool active[3];
+    float scale[3];
+    for (int a = 0; a < 3; ++a) {
+        active[a] = range.centroids.bmax[a] > range.centroids.bmin[a];
+        scale[a] = active[a] ? BinScale(range.centroids, a, num_bins) : 0.f;
+    }
+    ParallelFor(range.first, range.first + range.count, [&](std::size_t b, std::size_t e, int t) {
+        Bin *list = t == 0 ? bins : &more_bins[3 * num_bins * (t - 1)];
+        for (std::size_t k = b; k < e; ++k) {
+            const Ref &ref = refs[k];
+            const float c[3] = {ref.Centroid(0), ref.Centroid(1), ref.Centroid(2)};
+            for (int a = 0; a < 3; ++a) {
+                if (!active[a]) continue;
+                Bin &bin = list[a * num_bins + BinOf(c[a], range.centroids.bmin[a], scale[a], num_bins)];
+                bin.bounds.Grow(ref.bmin, ref.bmax);
+                bin.centroids.Grow(c, c);
+                ++bin.count;
+            }
+        }
+    }, threads);
+    for (std::size_t i = 0; i < more_bins.size(); ++i) {
+        Bin &bin = bins[i % (3 * num_bins)];
+        bin.bounds.Grow(more_bins[i].bounds);
+        bin.centroids.Grow(more_bins[i].centroids);
+        bin.count += more_bins[i].count;
+    }
+
+    Split best;
+    best.num_bins = num_bins;
+    best.axis = -1;
+    best.cost = FLT_MAX;
+    const float area = MAX(range.bounds.Area(), FLT_MIN);
+    for (int a = 0; a < 3; ++a) {
+        if (!active[a]) continue;
+        const Bin *list = &bins[a * num_bins];
+        // Sweep from the right first, then find the best boundary sweeping from the left.
+        float right_area[kBins];
+        Box box;
+        for (int i = num_bins - 1; i > 0; --i) {
+            box.Grow(list[i].bounds);
+            right_area[i] = box.Area();
+        }
+        box.Reset();
+        int left_count = 0;
+        for (int i = 1; i < num_bins; ++i) {
+            box.Grow(list[i - 1].bounds);
+            left_count += list[i - 1].count;
+            const int right_count = range.count - left_count;
+            if (left_count == 0 || right_count == 0) continue;
+            const float cost = kTraversalCost + (box.Area() * left_count + right_area[i] * right_count) / area;
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = a;
+                best.bin = i;
+            }
+        }
+    }
+    if (best.axis < 0) return best;
+
+    const Bin *list = &bins[best.axis * num_bins];
+    best.left.first = range.first;
+    best.left.count = 0;
+    best.right.count = 0;
+    for (int i = 0; i < num_bins; ++i) {
+        Range &side = i < best.bin ? best.left : best.right;
+        side.bounds.Grow(list[i].bounds);
+        side.centroids.Grow(list[i].centroids);
+        side.count += list[i].count;
+    }
+    best.right.first = range.first + best.left.count;
+    return best;
+}
+
+// Halves at the median centroid along the longest axis of the centroid box.
+inline void BVH::SplitMedian(std::vector<Ref> &refs, const Range &range, Range &left, Range &right) const {
+    int axis = 0;
+    for (int a = 1; a < 3; ++a) {
+        if (range.centroids.bmax[a] - range.centroids.bmin[a] > range.centroids.bmax[axis] - range.centroids.bmin[axis])
+            axis = a;
+    }
+    const int half = range.count / 2;
+    auto begin = refs.begin() + range.first;
+    std::nth_element(begin, begin + half, begin + range.count,
+                     [axis](const Ref &a, const Ref &b) { return a.Centroid(axis) < b.Centroid(axis); });
+    MakeRange(refs, range.first, half, left);
+    MakeRange(refs, range.first + half, range.count - half, right);
+}
+
+inline void BVH::MakeRange(const std::vector<Ref> &refs, int first, int count, Range &range) {
+    range.first = first;
+    range.count = count;
+    range.bounds.Reset();
+    range.centroids.Reset();
+    for (int k = first; k < first + count; ++k) {
+        const Ref &ref = refs[k];
+        const float c[3] = {ref.Centroid(0), ref.Centroid(1), ref.Centroid(2)};
+        range.bounds.Grow(ref.bmin, ref.bmax);
+        range.centroids.Grow(c, c);
+    }
+}
+
+inline void BVH::ComputeStats() {
+    m_stats.nodes = int(m_nodes.size());
+    m_stats.leaves = 0;
+    m_stats.depth = 0;
+    m_stats.sah_cost = 0.;
+    m_stats.bytes = m_nodes.size() * sizeof(Node) + m_faces.size() * sizeof(int) + m_tris.size() * sizeof(int) +
+                    m_positions.size() * sizeof(float);
+    if (m_nodes.empty()) return;
+    std::vector<int> depth(m_nodes.size(), 0);
+    Box root;
+    root.Grow(m_nodes[0].bmin, m_nodes[0].bmax);
+    const double root_area = MAX(root.Area(), FLT_MIN);
+    for (std::size_t i = 0; i < m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        Box box;
+        box.Grow(node.bmin, node.bmax);
+        const double p = box.Area() / root_area;
+        m_stats.depth = MAX(m_stats.depth, depth[i]);
+        if (node.IsLeaf()) {
+            ++m_stats.leaves;
+            m_stats.sah_cost += p * node.count;
+        } else {
+            m_stats.sah_cost += p * kTraversalCost;
+            depth[i + 1] = depth[node.index] = depth[i] + 1;
+        }
+    }
+}
+
+// Children follow their parent, so a backward sweep sees them first.
+inline void BVH::Refit(TriMesh &mesh, int num_threads) {
+    assert(mesh.GetTriangles().size() == m_tris.size() && "BVH.Refit: The mesh has other faces.");
+    const int threads = MIN<int>(NumThreads(num_threads), int(m_faces.size()) / kParallelFaces + 1);
+    CopyPositions(mesh, threads);
+    for (std::size_t i = m_nodes.size(); i-- > 0;) {
+        Node &node = m_nodes[i];
+        Box box;
+        if (node.IsLeaf()) {
+            for (int k = node.index; k < node.index + node.count; ++k) {
+                for (int c = 0; c < 3; ++c) {
+                    const float *p = &m_positions[3 * m_tris[3*k + c]];
+                    box.Grow(p, p);
+                }
+            }
+        } else {
+            box.Grow(m_nodes[i + 1].bmin, m_nodes[i + 1].bmax);
+            box.Grow(m_nodes[node.index].bmin, m_nodes[node.index].bmax);
+        }
+        for (int a = 0; a < 3; ++a) {
+            node.bmin[a] = box.bmin[a];
+            node.bmax[a] = box.bmax[a];
+        }
+    }
+}
+
+// Gribb and Hartmann: the planes are the sums and differences of the fourth row of the matrix with the others.
+inline void BVH::FrustumPlanes(const float m[16], float planes[6][4]) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            planes[2*i][j] = m[4*j + 3] + m[4*j + i];
+            planes[2*i + 1][j] = m[4*j + 3] - m[4*j + i];
+        }
+    }
+}
+
+inline std::pair<int, int> BVH::SubtreeFaces(int i) const {
+    int first = i, last = i;
+    while (!m_nodes[first].IsLeaf()) ++first;
+    while (!m_nodes[last].IsLeaf()) last = m_nodes[last].index;
+    return std::make_pair(m_nodes[first].index, m_nodes[last].index + m_nodes[last].count - m_nodes[first].index);
+}
+
+// A node entirely inside a plane does not test it again below; one inside all of them is taken whole.
+inline std::size_t BVH::CullFrustum(const float planes[6][4], std::vector<std::pair<int, int>> &ranges) const {
+    ranges.clear();
+    if (m_nodes.empty()) return 0;
+    std::size_t num_faces = 0;
+    std::pair<int, int> stack[kMaxDepth + 1];     // node, planes still to test as bits
+    int top = 0;
+    stack[top++] = std::make_pair(0, (1 << 6) - 1);
+    while (top > 0) {
+        const int i = stack[--top].first;
+        int mask = stack[top].second;
+        const Node &node = m_nodes[i];
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p) {
+            if (!(mask & (1 << p))) continue;
+            const float *plane = planes[p];
+            float far_side = plane[3], near_side = plane[3];    // corners farthest along and against the normal
+            for (int a = 0; a < 3; ++a) {
+                far_side += plane[a] * (plane[a] > 0.f ? node.bmax[a] : node.bmin[a]);
+                near_side += plane[a] * (plane[a] > 0.f ? node.bmin[a] : node.bmax[a]);
+            }
+            if (far_side < 0.f) outside = true;
+            else if (near_side >= 0.f) mask &= ~(1 << p);
+        }
+        if (outside) continue;
+        if (mask != 0 && !node.IsLeaf()) {
+            stack[top++] = std::make_pair(node.index, mask);
+            stack[top++] = std::make_pair(i + 1, mask);
+            continue;
+        }
+        const std::pair<int, int> faces = node.IsLeaf() ? std::make_pair(node.index, node.count) : SubtreeFaces(i);
+        if (!ranges.empty() && ranges.back().first + ranges.back().second == faces.first)
+            ranges.back().second += faces.second;
+        else
+            ranges.push_back(faces);
+        num_faces += faces.second;
+    }
+    return num_faces;
+}
+
+// Slab test; `t` is where the ray enters the box.
+inline bool BVH::IntersectBox(const Node &node, const float origin[3], const float inv_dir[3], float t_max,
+                              float &t) const {
+    float t_near = 0.f, t_far = t_max;
+    for (int a = 0; a < 3; ++a) {
+        float t0 = (node.bmin[a] - origin[a]) * inv_dir[a];
+        float t1 = (node.bmax[a] - origin[a]) * inv_dir[a];
+        if (t0 > t1) std::swap(t0, t1);
+        t_near = t0 > t_near ? t0 : t_near;     // NaN from 0 * inf leaves the interval as it is
+        t_far = t1 < t_far ? t1 : t_far;
+        if (t_near > t_far) return false;
+    }
+    t = t_near;
+    return true;
+}
+
+// Moller and Trumbore.
+inline bool BVH::IntersectTriangle(int k, const float origin[3], const float dir[3], float &t, float &u,
+                                   float &v) const {
+    const float *p0 = &m_positions[3 * m_tris[3*k]];
+    const float *p1 = &m_positions[3 * m_tris[3*k + 1]];
+    const float *p2 = &m_positions[3 * m_tris[3*k + 2]];
+    const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    const float q[3] = {dir[1]*e2[2] - dir[2]*e2[1], dir[2]*e2[0] - dir[0]*e2[2], dir[0]*e2[1] - dir[1]*e2[0]};
+    const float det = e1[0]*q[0] + e1[1]*q[1] + e1[2]*q[2];
+    if (det == 0.f) return false;
+    const float inv_det = 1.f / det;
+    const float s[3] = {origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2]};
+    u = (s[0]*q[0] + s[1]*q[1] + s[2]*q[2]) * inv_det;
+    if (u < 0.f || u > 1.f) return false;
+    const float r[3] = {s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0]};
+    v = (dir[0]*r[0] + dir[1]*r[1] + dir[2]*r[2]) * inv_det;
+    if (v < 0.f || u + v > 1.f) return false;
+    t = (e2[0]*r[0] + e2[1]*r[1] + e2[2]*r[2]) * inv_det;
+    return t >= 0.f;
+}
+
+// The nearer child is visited first, the farther one only if its box is still closer than the hit.
+inline bool BVH::Intersect(const float origin[3], const float dir[3], RayHit &hit, float t_max) const {
+    hit.face = -1;
+    hit.t = t_max;
+    if (m_nodes.empty()) return false;
+    const float inv_dir[3] = {1.f / dir[0], 1.f / dir[1], 1.f / dir[2]};
+    std::pair<int, float> stack[kMaxDepth + 1];   // node, entry distance
+    int top = 0;
+    float t = 0.f;
+    if (!IntersectBox(m_nodes[0], origin, inv_dir, hit.t, t)) return false;
+    stack[top++] = std::make_pair(0, t);
+    while (top > 0) {
+        --top;
+        if (stack[top].second >= hit.t) continue;
+        const Node &node = m_nodes[stack[top].first];
+        if (node.IsLeaf()) {
+            for (int k = node.index; k < node.index + node.count; ++k) {
+                float u, v;
+                if (IntersectTriangle(k, origin, dir, t, u, v) && t < hit.t) {
+                    hit.face = m_faces[k];
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                }
+            }
+            continue;
+        }
+        const int left = stack[top].first + 1, right = node.index;
+        float t_left = 0.f, t_right = 0.f;
+        const bool hit_left = IntersectBox(m_nodes[left], origin, inv_dir, hit.t, t_left);
+        const bool hit_right = IntersectBox(m_nodes[right], origin, inv_dir, hit.t, t_right);
+        if (hit_left && hit_right) {
+            if (t_left < t_right) {
+                stack[top++] = std::make_pair(right, t_right);
+                stack[top++] = std::make_pair(left, t_left);
+            } else {
+                stack[top++] = std::make_pair(left, t_left);
+                stack[top++] = std::make_pair(right, t_right);
+            }
+        } else if (hit_left) {
+            stack[top++] = std::make_pair(left, t_left);
+        } else if (hit_right) {
+            stack[top++] = std::make_pair(right, t_right);
+        }
+    }
+    return hit.face >= 0;
+}
+
+inline float BVH::BoxDistance2(const Node &node, const float p[3]) {
+    float d2 = 0.f;
+    for (int a = 0; a < 3; ++a) {
+        const float d = p[a] < node.bmin[a] ? node.bmin[a] - p[a] : (p[a] > node.bmax[a] ? p[a] - node.bmax[a] : 0.f);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+// Closest point `q` of triangle `k` to `p` by the Voronoi regions of its corners and edges (Ericson,
+// Real-Time Collision Detection 5.1.5).  Return the squared distance.
+inline float BVH::ClosestPoint(int k, const float p[3], float q[3]) const {
+    const float *a = &m_positions[3 * m_tris[3*k]];
+    const float *b = &m_positions[3 * m_tris[3*k + 1]];
+    const float *c = &m_positions[3 * m_tris[3*k + 2]];
+    auto dot = [](const float *x, const float *y) { return x[0]*y[0] + x[1]*y[1] + x[2]*y[2]; };
+    const float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    const float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    const float ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+    const float bp[3] = {p[0] - b[0], p[1] - b[1], p[2] - b[2]};
+    const float cp[3] = {p[0] - c[0], p[1] - c[1], p[2] - c[2]};
+    const float d1 = dot(ab, ap), d2 = dot(ac, ap), d3 = dot(ab, bp), d4 = dot(ac, bp);
+    const float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    float v, w;
+    if (d1 <= 0.f && d2 <= 0.f) {
+        v = w = 0.f;
+    } else if (d3 >= 0.f && d4 <= d3) {
+        v = 1.f; w = 0.f;
+    } else if (d6 >= 0.f && d5 <= d6) {
+        v = 0.f; w = 1.f;
+    } else {
+        const float vc = d1*d4 - d3*d2, vb = d5*d2 - d1*d6, va = d3*d6 - d5*d4;
+        if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+            v = d1 / (d1 - d3); w = 0.f;
+        } else if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+            v = 0.f; w = d2 / (d2 - d6);
+        } else if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f) {
+            w = (d4 - d3) / ((d4 - d3) + (d5 - d6)); v = 1.f - w;
+        } else {
+            const float denom = 1.f / (va + vb + vc);
+            v = vb * denom; w = vc * denom;
+        }
+    }
+    float d = 0.f;
+    for (int i = 0; i < 3; ++i) {
+        q[i] = a[i] + v * ab[i] + w * ac[i];
+        d += (p[i] - q[i]) * (p[i] - q[i]);
+    }
+    return d;
+}
+
+inline bool BVH::Nearest(const float p[3], NearestPoint &result, float max_distance) const {
+    result.face = -1;
+    result.distance = max_distance;
+    float best = max_distance < sqrtf(FLT_MAX) ? max_distance * max_distance : FLT_MAX;
+    if (m_nodes.empty()) return false;
+    std::pair<int, float> stack[kMaxDepth + 1];   // node, squared distance to its box
+    int top = 0;
+    stack[top++] = std::make_pair(0, BoxDistance2(m_nodes[0], p));
+    while (top > 0) {
+        --top;
+        if (stack[top].second > best) continue;
+        const Node &node = m_nodes[stack[top].first];
+        if (node.IsLeaf()) {
+            for (int k = node.index; k < node.index + node.count; ++k) {
+                float q[3];
+                const float d = ClosestPoint(k, p, q);
+                if (d <= best) {
+                    best = d;
+                    result.face = m_faces[k];
+                    for (int a = 0; a < 3; ++a) result.point[a] = q[a];
+                }
+            }
+            continue;
+        }
+        const int left = stack[top].first + 1, right = node.index;
+        const float d_left = BoxDistance2(m_nodes[left], p), d_right = BoxDistance2(m_nodes[right], p);
+        if (d_left < d_right) {
+            if (d_right <= best) stack[top++] = std::make_pair(right, d_right);
+            if (d_left <= best) stack[top++] = std::make_pair(left, d_left);
+        } else {
+            if (d_left <= best) stack[top++] = std::make_pair(left, d_left);
+            if (d_right <= best) stack[top++] = std::make_pair(right, d_right);
+        }
+    }
+    if (result.face < 0) return false;
+    result.distance = sqrtf(best);
+    return true;
+}
+
+#endif // LEOYOLO_BVH_H
@@ -0,0 +1,292 @@
+//
+// Compact, index-based half-edge storage for triangle meshes.
+// Positions, normals and connectivity live in contiguous arrays addressed by 32-bit handles,
+// instead of individually allocated elements linked by pointers as in TriMesh.
+// Interior half-edges are numbered by corner (3*f+k, see MeshTopology.h) and followed by the
+// boundary half-edges, so sweeps over faces or half-edges walk the arrays sequentially.
+// A half-edge costs 16 bytes (next, pair, vert, face); prev is next(next(h)) for triangles.
+//
+
+#ifndef LEOYOLO_COMPACTMESH_H
+#define LEOYOLO_COMPACTMESH_H
+
+#include "TriMesh.h"
+#include "MeshTopology.h"
+#include "MeshNormals.h"
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+
+static const uint32_t kInvalidIndex = 0xffffffffu;
+
+// Typed 32-bit index into the arrays of a CompactMesh.
+template <typename Tag>
+struct MeshHandle {
+    uint32_t idx;
+
+    explicit MeshHandle(uint32_t i = kInvalidIndex) : idx(i) {}
+    bool IsValid() const { return idx != kInvalidIndex; }
+    bool operator==(const MeshHandle &other) const { return idx == other.idx; }
+    bool operator!=(const MeshHandle &other) const { return idx != other.idx; }
+};
+
+struct VertTag;
+struct EdgeTag;
+struct FaceTag;
+typedef MeshHandle<VertTag> VertHandle;
+typedef MeshHandle<EdgeTag> EdgeHandle;
+typedef MeshHandle<FaceTag> FaceHandle;
+
+class CompactMesh {
+public:
+    CompactMesh() {}
+
+    // Build from `positions` (x, y, z per vertex) and `triangles` (three vertex indices per face).
+    // Faces are oriented consistently as in TriMesh.  Ids default to the element indices.
+    bool Build(std::vector<float> positions, std::vector<int> triangles,
+               std::vector<int> vert_ids = std::vector<int>(), std::vector<int> face_ids = std::vector<int>()) {
+        const std::size_t num_verts = positions.size() / 3;
+        const std::size_t num_faces = triangles.size() / 3;
+        for (int v : triangles) {
+            if (v < 0 || std::size_t(v) >= num_verts) {
+                printf("CompactMesh.Build: Face refers to vertex %d out of %d.\n", v, (int)num_verts);
+                return false;
+            }
+        }
+        m_position = std::move(positions);
+        if (vert_ids.size() != num_verts) {
+            vert_ids.resize(num_verts);
+            for (std::size_t i = 0; i < num_verts; ++i) vert_ids[i] = int(i);
+        }
+        if (face_ids.size() != num_faces) {
+            face_ids.resize(num_faces);
+            for (std::size_t i = 0; i < num_faces; ++i) face_ids[i] = int(i);
+        }
+        m_vert_id = std::move(vert_ids);
+        m_face_id = std::move(face_ids);
+
+        std::vector<int> &fvert = triangles;
+        std::vector<int> cpair;
+        int num_nonmanifold = PairCorners(fvert, int(num_verts), cpair);
+        if (num_nonmanifold > 0)
+            printf("CompactMesh.Build: %d edges are shared by more than two faces.\n", num_nonmanifold);
+        int num_conflicts = OrientCorners(fvert, cpair);
+        if (num_conflicts > 0)
+            printf("CompactMesh.Build: The mesh is not orientable (%d conflicting edges).\n", num_conflicts);
+
+        const uint32_t num_corners = uint32_t(fvert.size());
+        uint32_t num_edges = num_corners;
+        for (uint32_t c = 0; c < num_corners; ++c)
+            if (cpair[c] < 0) ++num_edges;
+        m_next.assign(num_edges, kInvalidIndex);
+        m_pair.assign(num_edges, kInvalidIndex);
+        m_vert.assign(num_edges, kInvalidIndex);
+        m_face.assign(num_edges, kInvalidIndex);
+        m_vert_edge.assign(num_verts, kInvalidIndex);
+        m_face_edge.resize(num_faces);
+        for (uint32_t c = 0; c < num_corners; ++c) {
+            m_next[c] = uint32_t(CornerNext(c));
+            m_vert[c] = uint32_t(fvert[CornerNext(c)]);
+            m_face[c] = c / 3;
+            if (cpair[c] >= 0) m_pair[c] = uint32_t(cpair[c]);
+            if (m_vert_edge[fvert[c]] == kInvalidIndex) m_vert_edge[fvert[c]] = c;
+        }
+        for (std::size_t f = 0; f < num_faces; ++f) m_face_edge[f] = uint32_t(3*f);
+        uint32_t b = num_corners;
+        for (uint32_t c = 0; c < num_corners; ++c) {
+            if (cpair[c] >= 0) continue;
+            m_vert[b] = uint32_t(fvert[c]);
+            m_pair[b] = c;
+            m_pair[c] = b;
+            m_vert_edge[fvert[c]] = c;  // boundary vertices start from the out edge paired with the boundary
+            ++b;
+        }
+        ComputeNormal();
+        return true;
+    }
+
+    // Copy a built TriMesh.  Vertices and faces keep their order and ids.
+    bool Build(TriMesh &mesh) {
+        std::vector<float> positions;
+        std::vector<int> vert_ids, face_ids, triangles;
+        positions.reserve(3 * mesh.NumVertices());
+        vert_ids.reserve(mesh.NumVertices());
+        for (auto it = mesh.GetVerticesBegin(); it != mesh.GetVerticesEnd(); ++it) {
+            positions.push_back((*it)->x);
+            positions.push_back((*it)->y);
+            positions.push_back((*it)->z);
+            vert_ids.push_back((*it)->id);
+        }
+        triangles.reserve(3 * mesh.NumFaces());
+        face_ids.reserve(mesh.NumFaces());
+        for (auto it = mesh.GetFacesBegin(); it != mesh.GetFacesEnd(); ++it) {
+            HE_edge *e = (*it)->edge;
+            if (e == nullptr) {
+                printf("CompactMesh.Build: Face %d has no edges, is the TriMesh updated?\n", (*it)->id);
+                return false;
+            }
+            // the face starts with the vertex its first half-edge leaves from
+            triangles.push_back(e->prev->vert->index);
+            triangles.push_back(e->vert->index);
+            triangles.push_back(e->next->vert->index);
+            face_ids.push_back((*it)->id);
+        }
+        return Build(std::move(positions), std::move(triangles), std::move(vert_ids), std::move(face_ids));
+    }
+
+    // Face normals, and vertex normals as the normalized weighted sum of the adjacent face normals.
+    // Computed by the kernels of MeshNormals.h, so degenerate faces and vertices are handled as in TriMesh.
+    void ComputeNormal(NormalWeighting weighting = NormalWeighting::Uniform) {
+        const int num_faces = int(NumFaces());
+        const int num_verts = int(NumVertices());
+        std::vector<float> px(num_verts), py(num_verts), pz(num_verts);
+        for (int v = 0; v < num_verts; ++v) {
+            px[v] = m_position[3*v];
+            py[v] = m_position[3*v + 1];
+            pz[v] = m_position[3*v + 2];
+        }
+        // corner c is the vertex its half-edge leaves, i.e. the end of the previous one
+        std::vector<int> tri(3 * num_faces), corners, offsets;
+        for (int c = 0; c < 3 * num_faces; ++c) tri[c] = int(m_vert[CornerPrev(c)]);
+        GroupByLabel(tri, num_verts, corners, offsets);
+        std::vector<float> fnx(num_faces), fny(num_faces), fnz(num_faces), cw(3 * num_faces);
+        std::vector<float> vnx(num_verts), vny(num_verts), vnz(num_verts);
+        ComputeFaceNormals(px.data(), py.data(), pz.data(), tri.data(), nullptr, 0, num_faces, weighting,
+                           fnx.data(), fny.data(), fnz.data(), cw.data());
+        ComputeVertexNormals(offsets.data(), corners.data(), fnx.data(), fny.data(), fnz.data(), cw.data(),
+                             nullptr, 0, num_verts, vnx.data(), vny.data(), vnz.data());
+        m_face_normal.resize(3 * num_faces);
+        for (int f = 0; f < num_faces; ++f) {
+            m_face_normal[3*f] = fnx[f];
+            m_face_normal[3*f + 1] = fny[f];
+            m_face_normal[3*f + 2] = fnz[f];
+        }
+        m_normal.resize(3 * num_verts);
+        for (int v = 0; v < num_verts; ++v) {
+            m_normal[3*v] = vnx[v];
+            m_normal[3*v + 1] = vny[v];
+            m_normal[3*v + 2] = vnz[v];
+        }
+    }
+
+    // element access
+    EdgeHandle Next(EdgeHandle h) const { return EdgeHandle(m_next[h.idx]); }
+    EdgeHandle Prev(EdgeHandle h) const {
+        return m_next[h.idx] == kInvalidIndex ? EdgeHandle() : EdgeHandle(m_next[m_next[h.idx]]);
+    }
+    EdgeHandle Pair(EdgeHandle h) const { return EdgeHandle(m_pair[h.idx]); }
+    VertHandle Vert(EdgeHandle h) const { return VertHandle(m_vert[h.idx]); }   // vertex at the end
+    FaceHandle Face(EdgeHandle h) const { return FaceHandle(m_face[h.idx]); }
+    EdgeHandle Edge(VertHandle v) const { return EdgeHandle(m_vert_edge[v.idx]); }  // an out edge
+    EdgeHandle Edge(FaceHandle f) const { return EdgeHandle(m_face_edge[f.idx]); }
+    const float *Position(VertHandle v) const { return &m_position[3 * v.idx]; }
+    const float *Normal(VertHandle v) const { return &m_normal[3 * v.idx]; }
+    const float *Normal(FaceHandle f) const { return &m_face_normal[3 * f.idx]; }
+    int Id(VertHandle v) const { return m_vert_id[v.idx]; }
+    int Id(FaceHandle f) const { return m_face_id[f.idx]; }
+
+    // contiguous arrays, e.g. for uploading to the GPU
+    const std::vector<float> &Positions() const { return m_position; }
+    const std::vector<float> &Normals() const { return m_normal; }
+
+    std::vector<VertHandle> GetVertexVertices(VertHandle v) const {
+        std::vector<EdgeHandle> out_edges = GetVertexOutEdges(v);
+        std::vector<VertHandle> verts(out_edges.size());
+        for (std::size_t i = 0; i < out_edges.size(); ++i) verts[i] = Vert(out_edges[i]);
+        return verts;
+    }
+
+    std::vector<EdgeHandle> GetVertexInEdges(VertHandle v) const {
+        std::vector<EdgeHandle> in_edges = GetVertexOutEdges(v);
+        for (auto &h : in_edges) h = Pair(h);
+        return in_edges;
+    }
+
+    // Same traversal as TriMesh::GetVertexOutEdges: around the vertex through pair->next, and if the
+    // boundary is hit, restart from the boundary in-edge going the other way through pair->prev.
+    std::vector<EdgeHandle> GetVertexOutEdges(VertHandle v) const {
+        assert(v.IsValid() && "CompactMesh.GetVertexOutEdges: Invalid handle.");
+        std::vector<EdgeHandle> out_edges;
+        EdgeHandle start = Edge(v);
+        if (!start.IsValid()) return out_edges;
+        EdgeHandle h = start;
+        do {
+            out_edges.push_back(h);
+            h = Pair(h);
+            if (Next(h).IsValid())
+                h = Next(h);
+            else
+                break;
+        } while (h != start);
+        if (h == start)
+            return out_edges;
+        out_edges.clear();
+        while (h.IsValid()) {
+            out_edges.push_back(Pair(h));
+            h = Prev(Pair(h));
+        }
+        return out_edges;
+    }
+
+    std::vector<FaceHandle> GetVertexFaces(VertHandle v) const {
+        std::vector<FaceHandle> faces;
+        for (EdgeHandle h : GetVertexOutEdges(v))
+            if (Face(h).IsValid()) faces.push_back(Face(h));
+        return faces;
+    }
+
+    std::vector<EdgeHandle> GetFaceEdges(FaceHandle f) const {
+        EdgeHandle h = Edge(f);
+        return std::vector<EdgeHandle>{h, Next(h), Next(Next(h))};
+    }
+
+    std::vector<VertHandle> GetFaceVertices(FaceHandle f) const {
+        EdgeHandle h = Edge(f);
+        return std::vector<VertHandle>{Vert(h), Vert(Next(h)), Vert(Next(Next(h)))};
+    }
+
+    std::vector<FaceHandle> GetFaceFaces(FaceHandle f) const {
+        std::vector<FaceHandle> faces;
+        for (EdgeHandle h : GetFaceEdges(f))
+            if (Face(Pair(h)).IsValid()) faces.push_back(Face(Pair(h)));
+        return faces;
+    }
+
+    // helpers
+
+    bool HalfEdgeOnBoundary(EdgeHandle h) const { return !Face(h).IsValid(); }
+    bool EdgeOnBoundary(EdgeHandle h) const { return HalfEdgeOnBoundary(h) || HalfEdgeOnBoundary(Pair(h)); }
+
+    std::size_t NumVertices() const { return m_vert_id.size(); }
+    std::size_t NumEdges() const { return m_next.size(); }
+    std::size_t NumFaces() const { return m_face_id.size(); }
+
+    // Bytes held by the arrays.
+    std::size_t MemoryUsage() const {
+        return sizeof(float) * (m_position.capacity() + m_normal.capacity() + m_face_normal.capacity()) +
+               sizeof(uint32_t) * (m_next.capacity() + m_pair.capacity() + m_vert.capacity() + m_face.capacity() +
+                                   m_vert_edge.capacity() + m_face_edge.capacity()) +
+               sizeof(int) * (m_vert_id.capacity() + m_face_id.capacity());
+    }
+
+private:
+    // per vertex
+    std::vector<float> m_position;      // x, y, z
+    std::vector<float> m_normal;        // nx, ny, nz
+    std::vector<uint32_t> m_vert_edge;  // one of the out edges
+    std::vector<int> m_vert_id;
+    // per face
+    std::vector<float> m_face_normal;
+    std::vector<uint32_t> m_face_edge;
+    std::vector<int> m_face_id;
+    // per half-edge
+    std::vector<uint32_t> m_next;
+    std::vector<uint32_t> m_pair;
+    std::vector<uint32_t> m_vert;       // vertex at the end of the half-edge
+    std::vector<uint32_t> m_face;
+};
+
+#endif // LEOYOLO_COMPACTMESH_H
@@ -7,49 +7,264 @@
 
 #include "common.h"
 #include "TriMesh.h"
+#include "CompactMesh.h"
+#include "MeshTopology.h"
+#include "MappedFile.h"
 #include <memory>
 #include <string>
+#include <vector>
+#include <utility>
 #include <stdio.h>
 #include <string.h>
-#include <sstream>
-#include <fstream>
+#include <charconv>
+#include <atomic>
+#include <mutex>
 
-std::shared_ptr<TriMesh> ReadMFile(const std::string &filename) {
-    std::ifstream m_file(filename, std::ios_base::in);
-    if (!m_file.is_open()) {
+// The parser works directly on the memory-mapped file: every line is tokenized in place,
+// and numbers are converted by std::from_chars, so nothing is allocated per line.
+// Large files are split at line boundaries into chunks which are parsed in parallel into
+// per-chunk buffers.  The buffers are merged in file order, so the mesh is identical
+// whatever the number of threads.
+
+struct MVertexRecord {
+    int id;
+    float x, y, z;
+};
+
+struct MFaceRecord {
+    int id;
+    int vertid[3];
+};
+
+// Everything parsed from one chunk of the file.
+struct MChunk {
+    std::vector<MVertexRecord> vertices;
+    std::vector<MFaceRecord> faces;
+    std::vector<std::pair<const char*, const char*>> bad_lines;    // reported after merging
+};
+
+static inline bool MIsBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline const char *MSkipBlanks(const char *p, const char *end) {
+    while (p < end && MIsBlank(*p)) ++p;
+    return p;
+}
+
+// Parse a number at `p`, skipping leading blanks.  Return false on malformed input.
+template <typename Number>
+static inline bool MParseNumber(const char *&p, const char *end, Number &value) {
+    p = MSkipBlanks(p, end);
+    if (p < end && *p == '+') ++p;  // from_chars does not accept an explicit plus sign
+    auto res = std::from_chars(p, end, value);
+    if (res.ec != std::errc()) return false;
+    p = res.ptr;
+    return true;
+}
+
+// Parse one line [begin, end) without the trailing newline.
+static bool ParseMLine(const char *begin, const char *end, MChunk &chunk) {
+    const char *p = MSkipBlanks(begin, end);
+    if (p == end || *p == '#') return true; // empty line or comment
+    const char *kind = p;
+    while (p < end && !MIsBlank(*p)) ++p;
+    size_t kind_len = static_cast<size_t>(p - kind);
+    if (kind_len == 6 && memcmp(kind, "Vertex", 6) == 0) {
+        MVertexRecord v;
+        if (!MParseNumber(p, end, v.id) || !MParseNumber(p, end, v.x) ||
+            !MParseNumber(p, end, v.y) || !MParseNumber(p, end, v.z))
+            return false;
+        chunk.vertices.push_back(v);
+    } else if (kind_len == 4 && memcmp(kind, "Face", 4) == 0) {
+        MFaceRecord f;
+        if (!MParseNumber(p, end, f.id) || !MParseNumber(p, end, f.vertid[0]) ||
+            !MParseNumber(p, end, f.vertid[1]) || !MParseNumber(p, end, f.vertid[2]))
+            return false;
+        chunk.faces.push_back(f);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Progress shared by the threads parsing one file.
+struct MParseProgress {
+    static const size_t kReportBytes = 4 << 20;     // report every 4MB parsed by a thread
+    const ProgressCallback *callback;
+    size_t total_bytes;
+    std::atomic<size_t> bytes_done;
+    std::atomic<bool> cancelled;
+    std::mutex report_mutex;    // the callback is never invoked concurrently
+
+    MParseProgress(const ProgressCallback *cb, size_t total)
+        : callback(cb), total_bytes(total), bytes_done(0), cancelled(false) {}
+
+    // Account for `bytes` more parsed bytes.  Return false if parsing should stop.
+    bool Advance(size_t bytes, float weight) {
+        size_t done = bytes_done.fetch_add(bytes) + bytes;
+        if (callback && *callback && report_mutex.try_lock()) {
+            if (!(*callback)(weight * float(done) / float(MAX<size_t>(total_bytes, 1))))
+                cancelled = true;
+            report_mutex.unlock();
+        }
+        return !cancelled;
+    }
+};
+
+static void ParseMChunk(const char *begin, const char *end, MChunk &chunk, MParseProgress &progress, float weight) {
+    const char *p = begin;
+    const char *reported = begin;
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (eol == nullptr) eol = end;
+        if (!ParseMLine(p, eol, chunk)) {
+            chunk.bad_lines.emplace_back(p, eol);
+        }
+        p = eol + 1;
+        if (static_cast<size_t>(p - reported) >= MParseProgress::kReportBytes) {
+            if (!progress.Advance(static_cast<size_t>(p - reported), weight)) return;
+            reported = p;
+        }
+    }
+}
+
+// Split [begin, end) into at most `num_chunks` pieces, each ending right after a newline.
+static std::vector<const char*> SplitMChunks(const char *begin, const char *end, int num_chunks) {
+    std::vector<const char*> bounds{begin};
+    size_t size = static_cast<size_t>(end - begin);
+    for (int i = 1; i < num_chunks; ++i) {
+        const char *p = begin + size*i/num_chunks;
+        if (p <= bounds.back()) continue;
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (eol == nullptr) break;
+        bounds.push_back(eol + 1);
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+// share of a whole load spent in each stage, used for progress reports; the topology build takes the rest
+static const float kMParseWeight = 0.25f;
+static const float kMInsertWeight = 0.1f;
+
+// Parse the mapped m-file into per-chunk buffers, in file order.  Malformed lines are reported.
+// Return false if the parse was canceled through `progress`.
+static bool ParseMFile(const MappedFile &m_file, int num_threads, const ProgressCallback &progress,
+                       std::vector<MChunk> &chunks) {
+    static const size_t kMinChunkSize = 1 << 20;    // not worth a thread below 1MB
+    int nthreads = NumThreads(num_threads);
+    nthreads = static_cast<int>(MIN<size_t>(nthreads, m_file.Size()/kMinChunkSize + 1));
+    std::vector<const char*> bounds = SplitMChunks(m_file.Data(), m_file.End(), nthreads);
+    chunks.clear();
+    chunks.resize(bounds.size() - 1);
+    MParseProgress parse_progress(&progress, m_file.Size());
+    ParallelFor(0, chunks.size(), [&](size_t cbegin, size_t cend, int) {
+        for (size_t c = cbegin; c < cend; ++c)
+            ParseMChunk(bounds[c], bounds[c+1], chunks[c], parse_progress, kMParseWeight);
+    }, nthreads);
+    if (parse_progress.cancelled) return false;
+    for (const auto &chunk : chunks) {
+        for (const auto &line : chunk.bad_lines) {
+            printf("ReadMFile: Unknown parse format:\n");
+            printf("%.*s\n", int(line.second - line.first), line.first);
+        }
+    }
+    return true;
+}
+
+// `num_threads` <= 0 uses all cores (see NumThreads), 1 parses serially.
+// `progress` may be called from the parsing threads, but never concurrently.  If it returns false,
+// reading is abandoned and nullptr is returned.
+inline std::shared_ptr<TriMesh> ReadMFile(const std::string &filename, int num_threads = 0,
+                                          const ProgressCallback &progress = ProgressCallback()) {
+    MappedFile m_file(filename);
+    if (!m_file.IsOpen()) {
         printf("ReadMFile: Cannot read mfile %s.\n", filename.c_str());
         return nullptr;
     }
     auto m_mesh = std::make_shared<TriMesh>();
-    std::string line;
-    int id;
-    float vert_coord[3];
-    int vert_id[3];
-    // char name[10];
-    std::string kind;
     tic();
-    while(std::getline(m_file, line)) {
-        if (line[0] == '#') continue;   // TODO: get rid of whitespaces
-        else {
-            std::stringstream ss(line, std::ios_base::in);
-            ss >> kind;
-            if (kind == "Vertex") {
-                ss >> id >> vert_coord[0] >> vert_coord[1] >> vert_coord[2];
-                m_mesh->InsertVertex(vert_coord[0], vert_coord[1], vert_coord[2], id);
-                // printf("Vertex: %f %f %f\n", vert_coord[0], vert_coord[1], vert_coord[2]);
-            }
-            else if (kind == "Face") {
-                ss >> id >> vert_id[0] >> vert_id[1] >> vert_id[2];
-                m_mesh->InsertFace(id, vert_id[0], vert_id[1], vert_id[2]);
-            }
-            else {
-                printf("ReadMFile: Unknown parse format:\n");
-                printf("%s\n", line.c_str());
-                continue;
+    std::vector<MChunk> chunks;
+    if (!ParseMFile(m_file, num_threads, progress, chunks)) {
+        printf("ReadMFile: Reading %s is canceled.\n", filename.c_str());
+        return nullptr;
+    }
+
+    // merge in file order
+    size_t num_vertices = 0, num_faces = 0;
+    for (const auto &chunk : chunks) {
+        num_vertices += chunk.vertices.size();
+        num_faces += chunk.faces.size();
+    }
+    m_mesh->Reserve(num_vertices, num_faces);
+    for (const auto &chunk : chunks) {
+        for (const auto &v : chunk.vertices)
+            m_mesh->InsertVertex(v.x, v.y, v.z, v.id);
+        for (const auto &f : chunk.faces)
+            m_mesh->InsertFace(f.id, f.vertid[0], f.vertid[1], f.vertid[2]);
+    }
+    printf("ReadMFile: Parsed %d vertices and %d faces in %d chunk(s).\n",
+           (int)num_vertices, (int)num_faces, (int)chunks.size());
+    if (progress && !progress(kMParseWeight + kMInsertWeight)) {
+        printf("ReadMFile: Reading %s is canceled.\n", filename.c_str());
+        return nullptr;
+    }
+    // real data is rarely clean
+    if (!m_mesh->Update(BuildMode::Tolerant, SubProgress(progress, kMParseWeight + kMInsertWeight, 1.f))) {
+        printf("ReadMFile: Reading %s is canceled.\n", filename.c_str());
+        return nullptr;
+    }
+    if (!m_mesh->GetBuildReport().IsClean())
+        m_mesh->GetBuildReport().Print();
+    toc();
+    return m_mesh;
+}
+
+// Same as ReadMFile, but into the compact index-based storage.
+inline std::shared_ptr<CompactMesh> ReadMFileCompact(const std::string &filename, int num_threads = 0,
+                                                     const ProgressCallback &progress = ProgressCallback()) {
+    MappedFile m_file(filename);
+    if (!m_file.IsOpen()) {
+        printf("ReadMFile: Cannot read mfile %s.\n", filename.c_str());
+        return nullptr;
+    }
+    tic();
+    std::vector<MChunk> chunks;
+    if (!ParseMFile(m_file, num_threads, progress, chunks)) {
+        printf("ReadMFile: Reading %s is canceled.\n", filename.c_str());
+        return nullptr;
+    }
+    std::vector<float> positions;
+    std::vector<int> vert_ids, face_ids, triangles;
+    for (const auto &chunk : chunks) {
+        for (const auto &v : chunk.vertices) {
+            positions.insert(positions.end(), {v.x, v.y, v.z});
+            vert_ids.push_back(v.id);
+        }
+    }
+    VertexIdMap idmap(vert_ids.size(), [&](size_t i) { return vert_ids[i]; });
+    for (const auto &chunk : chunks) {
+        for (const auto &f : chunk.faces) {
+            for (int k = 0; k < 3; ++k) {
+                int idx = idmap.Lookup(f.vertid[k]);
+                if (idx < 0) {
+                    printf("ReadMFile: Cannot find vertex of id %d.\n", f.vertid[k]);
+                    return nullptr;
+                }
+                triangles.push_back(idx);
             }
+            face_ids.push_back(f.id);
         }
     }
-    m_mesh->Update();
+    if (progress && !progress(kMParseWeight + kMInsertWeight)) {
+        printf("ReadMFile: Reading %s is canceled.\n", filename.c_str());
+        return nullptr;
+    }
+    auto m_mesh = std::make_shared<CompactMesh>();
+    if (!m_mesh->Build(std::move(positions), std::move(triangles), std::move(vert_ids), std::move(face_ids)))
+        return nullptr;
+    if (progress) progress(1.f);
     toc();
     return m_mesh;
 }
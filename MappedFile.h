@@ -0,0 +1,116 @@
+//
+// Read-only memory mapping of a whole file.
+// The mapping is released when the object goes out of scope.
+//
+
+#ifndef LEOYOLO_MAPPEDFILE_H
+#define LEOYOLO_MAPPEDFILE_H
+
+#include <string>
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename)
+        : m_data(nullptr), m_size(0), m_open(false) {
+        this->Open(filename);
+    }
+
+    ~MappedFile() {
+        this->Close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool IsOpen() const { return m_open; }
+    const char *Data() const { return m_data; }
+    const char *End() const { return m_data + m_size; }
+    size_t Size() const { return m_size; }
+
+private:
+#ifdef _WIN32
+    void Open(const std::string &filename) {
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            return;
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size == 0) { // nothing to map, but the file itself is valid
+            CloseHandle(file);
+            m_open = true;
+            return;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) return;
+        m_data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping);
+        m_open = (m_data != nullptr);
+    }
+
+    void Close() {
+        if (m_data) UnmapViewOfFile(m_data);
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+    }
+#else
+    void Open(const std::string &filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return;
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size == 0) { // mmap refuses zero-length mappings
+            ::close(fd);
+            m_open = true;
+            return;
+        }
+        void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);    // the mapping keeps its own reference to the file
+        if (p == MAP_FAILED) {
+            printf("MappedFile: mmap failed for %s.\n", filename.c_str());
+            m_size = 0;
+            return;
+        }
+        madvise(p, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char *>(p);
+        m_open = true;
+    }
+
+    void Close() {
+        if (m_data) munmap(const_cast<char *>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+    }
+#endif
+
+private:
+    const char *m_data;
+    size_t m_size;
+    bool m_open;
+};
+
+#endif // LEOYOLO_MAPPEDFILE_H
@@ -0,0 +1,77 @@
+//
+// Block arena for mesh elements.
+// Objects are carved out of large blocks and never freed one by one: all of them are destroyed
+// and the blocks released together by Clear() or the destructor.
+//
+
+#ifndef LEOYOLO_MEMORYPOOL_H
+#define LEOYOLO_MEMORYPOOL_H
+
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <stddef.h>
+
+template <typename T>
+class ElementPool {
+public:
+    explicit ElementPool(size_t block_size = 4096)
+        : m_blocks(), m_block_size(block_size), m_size(0) {}
+
+    ~ElementPool() {
+        this->Clear();
+    }
+
+    ElementPool(const ElementPool &) = delete;
+    ElementPool &operator=(const ElementPool &) = delete;
+
+    // Make room for `n` more elements in a single block, e.g. once the element count is known.
+    void Reserve(size_t n) {
+        if (m_blocks.empty() || m_blocks.back().capacity - m_blocks.back().used < n)
+            this->AddBlock(n > m_block_size ? n : m_block_size);
+    }
+
+    // Return a default constructed element.  Throw std::bad_alloc when out of memory.
+    T *New() {
+        if (m_blocks.empty() || m_blocks.back().used == m_blocks.back().capacity)
+            this->AddBlock(m_block_size);
+        Block &block = m_blocks.back();
+        T *obj = new (block.data + block.used) T();
+        ++block.used;
+        ++m_size;
+        return obj;
+    }
+
+    // Destroy all elements and release the blocks.  Destructors are skipped for trivial types.
+    void Clear() {
+        for (auto &block : m_blocks) {
+            if (!std::is_trivially_destructible<T>::value) {
+                for (size_t i = 0; i < block.used; ++i) block.data[i].~T();
+            }
+            ::operator delete(static_cast<void *>(block.data));
+        }
+        m_blocks.clear();
+        m_size = 0;
+    }
+
+    size_t Size() const { return m_size; }
+
+private:
+    struct Block {
+        T *data;
+        size_t capacity;
+        size_t used;
+    };
+
+    void AddBlock(size_t capacity) {
+        T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+        m_blocks.push_back(Block{data, capacity, 0});
+    }
+
+private:
+    std::vector<Block> m_blocks;
+    size_t m_block_size;
+    size_t m_size;
+};
+
+#endif // LEOYOLO_MEMORYPOOL_H
@@ -0,0 +1,281 @@
+//
+// Binary cache of a fully built TriMesh.
+// The cache lives next to the m-file and stores positions, normals and the half-edge
+// connectivity, so that reloading skips parsing, topology construction and normal computation.
+// A cache is only used if it was written for the current size and mtime of its source file.
+//
+
+#ifndef LEOYOLO_MESHCACHE_H
+#define LEOYOLO_MESHCACHE_H
+
+#include "common.h"
+#include "TriMesh.h"
+#include "MParser.h"
+#include "MappedFile.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char kMeshCacheMagic[8] = {'M', 'V', 'C', 'A', 'C', 'H', 'E', '\0'};
+static const uint32_t kMeshCacheVersion = 2;     // 2: edge ids are dense from 0 in every mesh
+static const uint32_t kMeshCacheByteOrder = 0x01020304;
+
+// File layout: header, then num_vertices CachedVertex, num_faces CachedFace, num_edges CachedEdge.
+// All references between elements are indices into these arrays, -1 standing for nullptr.
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;    // detects caches written on a host of different endianness
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t num_vertices;
+    uint32_t num_faces;
+    uint32_t num_edges;
+    uint32_t reserved;
+};
+
+struct CachedVertex {
+    float x, y, z;
+    float nx, ny, nz;
+    int32_t id;
+    int32_t edge;
+};
+
+struct CachedFace {
+    float nx, ny, nz;
+    int32_t id;
+    int32_t vertid[3];
+    int32_t edge;
+};
+
+struct CachedEdge {
+    int32_t id;
+    int32_t vert;
+    int32_t pair;
+    int32_t face;
+    int32_t next;   // prev is recovered as next->next since all faces are triangles
+};
+
+static_assert(sizeof(MeshCacheHeader) == 48, "MeshCacheHeader must not be padded.");
+static_assert(sizeof(CachedVertex) == 32 && sizeof(CachedFace) == 32 && sizeof(CachedEdge) == 20,
+              "Cache records must not be padded.");
+
+inline std::string MeshCacheFilename(const std::string &filename) {
+    return filename + ".cache";
+}
+
+// Size and modification time of `filename`.  Return false if the file does not exist.
+inline bool MeshCacheSourceStat(const std::string &filename, uint64_t &size, int64_t &mtime) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return false;
+    size = static_cast<uint64_t>(st.st_size);
+#if defined(__linux__)
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    mtime = static_cast<int64_t>(st.st_mtime) * 1000000000LL;
+#endif
+    return true;
+}
+
+// Write `mesh` to `cache_filename`, stamped with the size and mtime of `source_filename`.
+// The cache is written to a temporary file first, so a partially written cache is never picked up.
+inline bool WriteMeshCache(TriMesh &mesh, const std::string &cache_filename, const std::string &source_filename) {
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMeshCacheMagic, sizeof(header.magic));
+    header.version = kMeshCacheVersion;
+    header.byte_order = kMeshCacheByteOrder;
+    if (!MeshCacheSourceStat(source_filename, header.source_size, header.source_mtime)) {
+        printf("WriteMeshCache: Cannot stat source file %s.\n", source_filename.c_str());
+        return false;
+    }
+    header.num_vertices = static_cast<uint32_t>(mesh.NumVertices());
+    header.num_faces = static_cast<uint32_t>(mesh.NumFaces());
+    header.num_edges = static_cast<uint32_t>(mesh.NumEdges());
+
+    // Edge ids are the positions of the edges (dense per mesh, checked by TriMesh::Validate).  The face of an
+    // edge is found through the id of the edge, from the loop of half-edges of every face.
+    std::vector<int32_t> edge_face(mesh.NumEdges(), -1);
+    int32_t i = 0;
+    for (auto it = mesh.GetFacesBegin(); it != mesh.GetFacesEnd(); ++it, ++i) {
+        const HE_edge *e = (*it)->edge;
+        for (int k = 0; e != nullptr && k < 3; ++k, e = e->next) edge_face[e->id] = i;
+    }
+    auto vidx = [&](const HE_vert *v) { return v ? int32_t(v->index) : -1; };
+    auto eidx = [&](const HE_edge *e) { return e ? int32_t(e->id) : -1; };
+
+    std::string tmp_filename = cache_filename + ".tmp";
+    FILE *fp = fopen(tmp_filename.c_str(), "wb");
+    if (fp == nullptr) {
+        printf("WriteMeshCache: Cannot open %s for writing.\n", tmp_filename.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (auto it = mesh.GetVerticesBegin(); ok && it != mesh.GetVerticesEnd(); ++it) {
+        const HE_vert *v = *it;
+        CachedVertex cv{v->x, v->y, v->z, v->nx, v->ny, v->nz, v->id, eidx(v->edge)};
+        ok = fwrite(&cv, sizeof(cv), 1, fp) == 1;
+    }
+    for (auto it = mesh.GetFacesBegin(); ok && it != mesh.GetFacesEnd(); ++it) {
+        const HE_face *f = *it;
+        CachedFace cf{f->nx, f->ny, f->nz, f->id, {f->vertid[0], f->vertid[1], f->vertid[2]}, eidx(f->edge)};
+        ok = fwrite(&cf, sizeof(cf), 1, fp) == 1;
+    }
+    for (auto it = mesh.GetEdgesBegin(); ok && it != mesh.GetEdgesEnd(); ++it) {
+        const HE_edge *e = *it;
+        CachedEdge ce{e->id, vidx(e->vert), eidx(e->pair), e->face ? edge_face[e->id] : -1, eidx(e->next)};
+        ok = fwrite(&ce, sizeof(ce), 1, fp) == 1;
+    }
+    ok = (fclose(fp) == 0) && ok;
+    if (ok) {
+        remove(cache_filename.c_str());     // rename does not overwrite on every platform
+        ok = rename(tmp_filename.c_str(), cache_filename.c_str()) == 0;
+    }
+    if (!ok) {
+        printf("WriteMeshCache: Failed to write %s.\n", cache_filename.c_str());
+        remove(tmp_filename.c_str());
+    }
+    return ok;
+}
+
+// Load a mesh from `cache_filename`.  Return nullptr if the cache is missing, corrupted or stale
+// with respect to `source_filename`.  `progress` is called between the stages of the load; if it returns
+// false, reading is abandoned and nullptr is returned.
+inline std::shared_ptr<TriMesh> ReadMeshCache(const std::string &cache_filename, const std::string &source_filename,
+                                              const ProgressCallback &progress = ProgressCallback()) {
+    auto canceled = [&](float fraction) {
+        if (!progress || progress(fraction)) return false;
+        printf("ReadMeshCache: Reading %s is canceled.\n", cache_filename.c_str());
+        return true;
+    };
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (!MeshCacheSourceStat(source_filename, source_size, source_mtime)) return nullptr;
+    MappedFile m_file(cache_filename);
+    if (!m_file.IsOpen() || m_file.Size() < sizeof(MeshCacheHeader)) return nullptr;
+    MeshCacheHeader header;
+    memcpy(&header, m_file.Data(), sizeof(header));
+    if (memcmp(header.magic, kMeshCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != kMeshCacheVersion || header.byte_order != kMeshCacheByteOrder) {
+        printf("ReadMeshCache: %s is not a valid cache of this version.\n", cache_filename.c_str());
+        return nullptr;
+    }
+    if (header.source_size != source_size || header.source_mtime != source_mtime) {
+        printf("ReadMeshCache: %s is stale.\n", cache_filename.c_str());
+        return nullptr;
+    }
+    const uint64_t nv = header.num_vertices, nf = header.num_faces, ne = header.num_edges;
+    if (m_file.Size() != sizeof(MeshCacheHeader) + nv*sizeof(CachedVertex) +
+                         nf*sizeof(CachedFace) + ne*sizeof(CachedEdge)) {
+        printf("ReadMeshCache: %s is truncated.\n", cache_filename.c_str());
+        return nullptr;
+    }
+    const CachedVertex *cverts = reinterpret_cast<const CachedVertex *>(m_file.Data() + sizeof(MeshCacheHeader));
+    const CachedFace *cfaces = reinterpret_cast<const CachedFace *>(cverts + nv);
+    const CachedEdge *cedges = reinterpret_cast<const CachedEdge *>(cfaces + nf);
+
+    // indices must stay inside the arrays, otherwise the cache is corrupted
+    auto valid = [](int32_t idx, uint64_t n) { return idx >= -1 && idx < int64_t(n); };
+    for (uint64_t i = 0; i < nv; ++i)
+        if (!valid(cverts[i].edge, ne)) return nullptr;
+    for (uint64_t i = 0; i < nf; ++i)
+        if (!valid(cfaces[i].edge, ne)) return nullptr;
+    for (uint64_t i = 0; i < ne; ++i)
+        if (!valid(cedges[i].vert, nv) || !valid(cedges[i].pair, ne) ||
+            !valid(cedges[i].face, nf) || !valid(cedges[i].next, ne)) return nullptr;
+    if (canceled(0.05f)) return nullptr;
+
+    tic();
+    auto m_mesh = std::make_shared<TriMesh>();
+    m_mesh->Reserve(nv, nf, ne);
+    std::vector<HE_vert*> verts(nv);
+    std::vector<HE_face*> faces(nf);
+    std::vector<HE_edge*> edges(ne);
+    for (uint64_t i = 0; i < nv; ++i) {
+        const CachedVertex &cv = cverts[i];
+        verts[i] = m_mesh->InsertVertex(cv.x, cv.y, cv.z, cv.id);
+        verts[i]->nx = cv.nx; verts[i]->ny = cv.ny; verts[i]->nz = cv.nz;
+    }
+    for (uint64_t i = 0; i < nf; ++i) {
+        const CachedFace &cf = cfaces[i];
+        faces[i] = m_mesh->InsertFace(cf.id, cf.vertid[0], cf.vertid[1], cf.vertid[2]);
+        faces[i]->nx = cf.nx; faces[i]->ny = cf.ny; faces[i]->nz = cf.nz;
+    }
+    for (uint64_t i = 0; i < ne; ++i) {
+        edges[i] = m_mesh->InsertEdge(cedges[i].id);
+    }
+    if (canceled(0.45f)) return nullptr;
+    auto vptr = [&](int32_t idx) { return idx < 0 ? nullptr : verts[idx]; };
+    auto fptr = [&](int32_t idx) { return idx < 0 ? nullptr : faces[idx]; };
+    auto eptr = [&](int32_t idx) { return idx < 0 ? nullptr : edges[idx]; };
+    for (uint64_t i = 0; i < ne; ++i) {
+        const CachedEdge &ce = cedges[i];
+        HE_edge *e = edges[i];
+        e->vert = vptr(ce.vert);
+        e->pair = eptr(ce.pair);
+        e->face = fptr(ce.face);
+        e->next = eptr(ce.next);
+    }
+    for (uint64_t i = 0; i < ne; ++i) {
+        HE_edge *e = edges[i];
+        if (e->next && e->next->next) e->prev = e->next->next;
+    }
+    for (uint64_t i = 0; i < nv; ++i) verts[i]->edge = eptr(cverts[i].edge);
+    for (uint64_t i = 0; i < nf; ++i) faces[i]->edge = eptr(cfaces[i].edge);
+    if (canceled(0.6f)) return nullptr;
+    m_mesh->BuildTables();
+    printf("ReadMeshCache: Loaded %d vertices, %d faces and %d half edges from %s.\n",
+           (int)nv, (int)nf, (int)ne, cache_filename.c_str());
+    toc();
+    if (progress) progress(1.f);
+    return m_mesh;
+}
+
+// share of a load spent in each stage, used for progress reports: reading the cache, then validating
+// it; or reading the m-file, validating it, and writing the cache
+static const float kCacheReadWeight = 0.75f;
+static const float kMFileReadWeight = 0.65f;
+static const float kMFileValidateWeight = 0.1f;
+
+// Load the mesh from its cache if there is a fresh one, otherwise parse the m-file and write the cache.
+// Every mesh is validated: a cache failing validation is ignored and rebuilt, a parsed mesh failing it
+// is not cached.  `progress` covers the whole load; if it returns false, loading is abandoned and nullptr
+// is returned.
+inline std::shared_ptr<TriMesh> LoadMesh(const std::string &filename,
+                                         const ProgressCallback &progress = ProgressCallback()) {
+    // remember a cancel, so that a canceled cache read does not fall back to parsing
+    bool canceled = false;
+    ProgressCallback report;
+    if (progress) report = [&](float fraction) { canceled = canceled || !progress(fraction); return !canceled; };
+    std::string cache_filename = MeshCacheFilename(filename);
+    auto mesh = ReadMeshCache(cache_filename, filename, SubProgress(report, 0.f, kCacheReadWeight));
+    if (canceled) return nullptr;
+    if (mesh) {
+        ValidationResult result = mesh->Validate(0, SubProgress(report, kCacheReadWeight, 1.f));
+        if (canceled) return nullptr;
+        if (result.IsValid()) return mesh;
+        printf("LoadMesh: Cache %s failed validation, reading %s again.\n", cache_filename.c_str(), filename.c_str());
+        result.Print();
+    }
+    mesh = ReadMFile(filename, 0, SubProgress(report, 0.f, kMFileReadWeight));
+    if (!mesh) return mesh;
+    ValidationResult result =
+        mesh->Validate(0, SubProgress(report, kMFileReadWeight, kMFileReadWeight + kMFileValidateWeight));
+    if (canceled) return nullptr;
+    if (result.IsValid()) {
+        WriteMeshCache(*mesh, cache_filename, filename);
+    } else {
+        printf("LoadMesh: %s failed validation.\n", filename.c_str());
+        result.Print();
+    }
+    if (progress) progress(1.f);
+    return mesh;
+}
+
+#endif // LEOYOLO_MESHCACHE_H
@@ -0,0 +1,165 @@
+//
+// Face and vertex normal kernels over flat arrays, used by TriMesh::ComputeNormal.
+// Vertex positions are given as three separate coordinate arrays and faces as three vertex indices
+// each (`tri`), corner c = 3*f+k being the k-th corner of face f as in MeshTopology.h.
+// Faces are processed in batches of SIMD lanes: AVX when compiled with -mavx, SSE2 on x86 otherwise,
+// and plain scalar code elsewhere.
+//
+
+#ifndef LEOYOLO_MESHNORMALS_H
+#define LEOYOLO_MESHNORMALS_H
+
+#include <math.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEOYOLO_NORMALS_SSE2
+#endif
+
+// How the normals of the faces around a vertex are weighted in its normal.
+enum class NormalWeighting {
+    Uniform,    // every incident face counts the same
+    Area,       // by the area of the face
+    Angle       // by the angle of the face at the vertex
+};
+
+// Triangles whose cross product is shorter than this fraction of their squared edge lengths (collinear
+// or coincident corners) are degenerate.  They get a zero normal and do not contribute to vertex normals.
+// Vertices without any contribution, or whose face normals cancel out, get (0, 0, 1).
+const float kDegenerateNormal = 1e-6f;
+
+// Thin wrapper of the SIMD registers so that the face kernel is written once.
+struct NormalLanes {
+#if defined(__AVX__)
+    typedef __m256 V;
+    enum { kWidth = 8 };
+    static V Load(const float *p) { return _mm256_loadu_ps(p); }
+    static void Store(float *p, V a) { _mm256_storeu_ps(p, a); }
+    static V Set(float a) { return _mm256_set1_ps(a); }
+    static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+    static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+    static V MaskGreater(V a, V b, V x) { return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), x); }
+#elif defined(LEOYOLO_NORMALS_SSE2)
+    typedef __m128 V;
+    enum { kWidth = 4 };
+    static V Load(const float *p) { return _mm_loadu_ps(p); }
+    static void Store(float *p, V a) { _mm_storeu_ps(p, a); }
+    static V Set(float a) { return _mm_set1_ps(a); }
+    static V Add(V a, V b) { return _mm_add_ps(a, b); }
+    static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V Div(V a, V b) { return _mm_div_ps(a, b); }
+    static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+    static V Max(V a, V b) { return _mm_max_ps(a, b); }
+    static V MaskGreater(V a, V b, V x) { return _mm_and_ps(_mm_cmpgt_ps(a, b), x); }
+#else
+    typedef float V;
+    enum { kWidth = 1 };
+    static V Load(const float *p) { return *p; }
+    static void Store(float *p, V a) { *p = a; }
+    static V Set(float a) { return a; }
+    static V Add(V a, V b) { return a + b; }
+    static V Sub(V a, V b) { return a - b; }
+    static V Mul(V a, V b) { return a * b; }
+    static V Div(V a, V b) { return a / b; }
+    static V Sqrt(V a) { return sqrtf(a); }
+    static V Max(V a, V b) { return a > b ? a : b; }
+    static V MaskGreater(V a, V b, V x) { return a > b ? x : 0.f; }
+#endif
+};
+
+// Unit normals (fnx, fny, fnz) of the faces [begin, end) and the weights `cw` of their corners in the
+// vertex normals.  The normal of face (v0, v1, v2) is (v1 - v0) x (v2 - v0).
+// If `faces` is given, the faces faces[begin .. end) are processed instead, e.g. the ones around an edit.
+inline void ComputeFaceNormals(const float *px, const float *py, const float *pz, const int *tri,
+                               const int *faces, int begin, int end, NormalWeighting weighting,
+                               float *fnx, float *fny, float *fnz, float *cw) {
+    typedef NormalLanes L;
+    const int W = L::kWidth;
+    float g[9][W];          // gathered x, y, z of the three corners
+    float out[7][W];        // normal, length and corner dot products
+    for (int f0 = begin; f0 < end; f0 += W) {
+        const int n = end - f0 < W ? end - f0 : W;
+        for (int i = 0; i < W; ++i) {
+            const int j = f0 + (i < n ? i : n - 1);     // pad the last batch with its last face
+            const int *t = tri + 3 * (faces ? faces[j] : j);
+            for (int k = 0; k < 3; ++k) {
+                g[3*k][i] = px[t[k]];
+                g[3*k + 1][i] = py[t[k]];
+                g[3*k + 2][i] = pz[t[k]];
+            }
+        }
+        L::V x0 = L::Load(g[0]), y0 = L::Load(g[1]), z0 = L::Load(g[2]);
+        L::V ax = L::Sub(L::Load(g[3]), x0), ay = L::Sub(L::Load(g[4]), y0), az = L::Sub(L::Load(g[5]), z0);
+        L::V bx = L::Sub(L::Load(g[6]), x0), by = L::Sub(L::Load(g[7]), y0), bz = L::Sub(L::Load(g[8]), z0);
+        L::V nx = L::Sub(L::Mul(ay, bz), L::Mul(az, by));
+        L::V ny = L::Sub(L::Mul(az, bx), L::Mul(ax, bz));
+        L::V nz = L::Sub(L::Mul(ax, by), L::Mul(ay, bx));
+        L::V len = L::Sqrt(L::Add(L::Add(L::Mul(nx, nx), L::Mul(ny, ny)), L::Mul(nz, nz)));
+        L::V scale = L::Add(L::Add(L::Add(L::Mul(ax, ax), L::Mul(ay, ay)), L::Add(L::Mul(az, az), L::Mul(bx, bx))),
+                            L::Add(L::Mul(by, by), L::Mul(bz, bz)));
+        L::V eps = L::Mul(scale, L::Set(kDegenerateNormal));
+        L::V inv = L::MaskGreater(len, eps, L::Div(L::Set(1.f), L::Max(len, L::Set(1e-30f))));
+        L::Store(out[0], L::Mul(nx, inv));
+        L::Store(out[1], L::Mul(ny, inv));
+        L::Store(out[2], L::Mul(nz, inv));
+        L::Store(out[3], L::MaskGreater(len, eps, len));
+        if (weighting == NormalWeighting::Angle) {
+            // corner k sits between the edges towards corners k+1 and k+2, and |a x b| = len for all of them
+            L::V cx = L::Sub(bx, ax), cy = L::Sub(by, ay), cz = L::Sub(bz, az);
+            L::Store(out[4], L::Add(L::Add(L::Mul(ax, bx), L::Mul(ay, by)), L::Mul(az, bz)));
+            L::Store(out[5], L::Sub(L::Set(0.f), L::Add(L::Add(L::Mul(ax, cx), L::Mul(ay, cy)), L::Mul(az, cz))));
+            L::Store(out[6], L::Add(L::Add(L::Mul(bx, cx), L::Mul(by, cy)), L::Mul(bz, cz)));
+        }
+        for (int i = 0; i < n; ++i) {
+            const int f = faces ? faces[f0 + i] : f0 + i;
+            fnx[f] = out[0][i];
+            fny[f] = out[1][i];
+            fnz[f] = out[2][i];
+            for (int k = 0; k < 3; ++k) {
+                float w = 0.f;
+                if (out[3][i] > 0.f) {
+                    if (weighting == NormalWeighting::Uniform) w = 1.f;
+                    else if (weighting == NormalWeighting::Area) w = 0.5f * out[3][i];
+                    else w = atan2f(out[3][i], out[4 + k][i]);
+                }
+                cw[3*f + k] = w;
+            }
+        }
+    }
+}
+
+// Normals of the vertices [begin, end) from the face normals and corner weights.  The corners of vertex v
+// are corners[offsets[v] .. offsets[v+1]).  If `verts` is given, verts[begin .. end) are processed instead.
+inline void ComputeVertexNormals(const int *offsets, const int *corners,
+                                 const float *fnx, const float *fny, const float *fnz, const float *cw,
+                                 const int *verts, int begin, int end, float *vnx, float *vny, float *vnz) {
+    for (int j = begin; j < end; ++j) {
+        const int v = verts ? verts[j] : j;
+        float nx = 0.f, ny = 0.f, nz = 0.f, wsum = 0.f;
+        for (int i = offsets[v]; i < offsets[v + 1]; ++i) {
+            const int c = corners[i], f = c / 3;
+            wsum += cw[c];
+            nx += cw[c] * fnx[f];
+            ny += cw[c] * fny[f];
+            nz += cw[c] * fnz[f];
+        }
+        float norm = sqrtf(nx*nx + ny*ny + nz*nz);
+        if (norm > kDegenerateNormal * wsum) {
+            vnx[v] = nx / norm;
+            vny[v] = ny / norm;
+            vnz[v] = nz / norm;
+        } else {
+            vnx[v] = 0.f;
+            vny[v] = 0.f;
+            vnz[v] = 1.f;
+        }
+    }
+}
+
+#endif // LEOYOLO_MESHNORMALS_H
@@ -0,0 +1,320 @@
+//
+// Corner-based construction of triangle mesh connectivity, shared by TriMesh and CompactMesh.
+// Corner c = 3*f+k is the k-th corner of face f and stands for the half-edge fvert[c] -> fvert[CornerNext(c)],
+// where `fvert` holds three vertex indices per face.  Everything is kept in flat arrays.
+//
+
+#ifndef LEOYOLO_MESHTOPOLOGY_H
+#define LEOYOLO_MESHTOPOLOGY_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdio.h>
+
+inline int CornerNext(int c) { return c % 3 == 2 ? c - 2 : c + 1; }
+inline int CornerPrev(int c) { return c % 3 == 0 ? c + 2 : c - 1; }
+
+// Map from vertex ids (as found in m-files) to vertex indices.
+// Ids are looked up in a dense table when they are compact enough (the usual case for m-files),
+// otherwise by binary search in a sorted table.  If several vertices share an id the last one wins.
+class VertexIdMap {
+public:
+    // `get_id(i)` returns the id of the i-th of `num_verts` vertices.
+    template <typename GetId>
+    VertexIdMap(std::size_t num_verts, GetId get_id) : m_min_id(0), m_max_id(-1), m_dense(true) {
+        if (num_verts == 0) return;
+        m_min_id = m_max_id = get_id(0);
+        for (std::size_t i = 0; i < num_verts; ++i) {
+            m_min_id = std::min<long long>(m_min_id, get_id(i));
+            m_max_id = std::max<long long>(m_max_id, get_id(i));
+        }
+        m_dense = m_max_id - m_min_id < 4 * (long long)num_verts + 1024;
+        if (m_dense) {
+            m_table.assign(m_max_id - m_min_id + 1, -1);
+            for (std::size_t i = 0; i < num_verts; ++i) m_table[get_id(i) - m_min_id] = int(i);
+        } else {
+            m_sorted.reserve(num_verts);
+            for (std::size_t i = 0; i < num_verts; ++i) m_sorted.emplace_back(get_id(i), int(i));
+            std::stable_sort(m_sorted.begin(), m_sorted.end(),
+                [](const std::pair<int, int> &a, const std::pair<int, int> &b) { return a.first < b.first; });
+        }
+    }
+
+    // Return the index of the vertex of `id`, or -1 if there is none.
+    int Lookup(int id) const {
+        if (m_dense)
+            return (id < m_min_id || id > m_max_id) ? -1 : m_table[id - m_min_id];
+        auto it = std::upper_bound(m_sorted.begin(), m_sorted.end(), id,
+            [](int key, const std::pair<int, int> &p) { return key < p.first; });
+        return (it == m_sorted.begin() || (it-1)->first != id) ? -1 : (it-1)->second;
+    }
+
+private:
+    long long m_min_id, m_max_id;
+    bool m_dense;
+    std::vector<int> m_table;
+    std::vector<std::pair<int, int>> m_sorted;  // (id, index) sorted by id
+};
+
+// Disjoint sets over 0..n-1 with union by size and path halving.
+// https://en.wikipedia.org/wiki/Disjoint-set_data_structure
+class DisjointSets {
+public:
+    explicit DisjointSets(int n) : m_parent(n), m_size(n, 1) {
+        for (int i = 0; i < n; ++i) m_parent[i] = i;
+    }
+
+    int Find(int x) {
+        while (m_parent[x] != x) {
+            m_parent[x] = m_parent[m_parent[x]];
+            x = m_parent[x];
+        }
+        return x;
+    }
+
+    void Union(int a, int b) {
+        a = Find(a);
+        b = Find(b);
+        if (a == b) return;
+        if (m_size[a] < m_size[b]) std::swap(a, b);
+        m_parent[b] = a;
+        m_size[a] += m_size[b];
+    }
+
+private:
+    std::vector<int> m_parent;
+    std::vector<int> m_size;
+};
+
+// Label the connected components of the faces, two faces being connected if they share a vertex.
+// Components are numbered in the order of their first face.  vert_comp is -1 for vertices not used
+// by any face.  Return the number of components.  Complexity O(V+F) (amortized).
+inline int LabelComponents(const std::vector<int> &fvert, int num_verts,
+                           std::vector<int> &face_comp, std::vector<int> &vert_comp) {
+    const int num_faces = int(fvert.size() / 3);
+    DisjointSets sets(num_verts);
+    for (int c = 0; c < 3 * num_faces; ++c) {
+        if (fvert[c] >= 0 && fvert[CornerNext(c)] >= 0) sets.Union(fvert[c], fvert[CornerNext(c)]);
+    }
+    std::vector<int> root_comp(num_verts, -1);
+    face_comp.assign(num_faces, -1);
+    int num_comps = 0;
+    for (int f = 0; f < num_faces; ++f) {
+        int v = fvert[3*f] >= 0 ? fvert[3*f] : (fvert[3*f + 1] >= 0 ? fvert[3*f + 1] : fvert[3*f + 2]);
+        if (v < 0) {
+            face_comp[f] = num_comps++;     // no valid vertex, a component by itself
+            continue;
+        }
+        int &comp = root_comp[sets.Find(v)];
+        if (comp < 0) comp = num_comps++;
+        face_comp[f] = comp;
+    }
+    vert_comp.resize(num_verts);
+    for (int v = 0; v < num_verts; ++v) vert_comp[v] = root_comp[sets.Find(v)];
+    return num_comps;
+}
+
+// Group the elements 0..n-1 by their label with a counting sort: the elements of label l are
+// order[offsets[l] .. offsets[l+1]), in increasing order.  Elements labelled -1 are left out.
+inline void GroupByLabel(const std::vector<int> &label, int num_labels,
+                         std::vector<int> &order, std::vector<int> &offsets) {
+    offsets.assign(num_labels + 1, 0);
+    for (int l : label) {
+        if (l >= 0) offsets[l + 1]++;
+    }
+    for (int l = 0; l < num_labels; ++l) offsets[l + 1] += offsets[l];
+    order.assign(offsets[num_labels], -1);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < label.size(); ++i) {
+        if (label[i] >= 0) order[fill[label[i]]++] = int(i);
+    }
+}
+
+// Bucket the corners by the smaller vertex index of their edge with a counting sort: the corners of
+// vertex v are bucket[offsets[v] .. offsets[v+1]).  Corners with an invalid vertex are left out.
+inline void BucketCorners(const std::vector<int> &fvert, int num_verts,
+                          std::vector<int> &offsets, std::vector<int> &bucket) {
+    const int num_corners = int(fvert.size());
+    auto valid = [&](int c) { return fvert[c] >= 0 && fvert[CornerNext(c)] >= 0; };
+    auto lo = [&](int c) { return std::min(fvert[c], fvert[CornerNext(c)]); };
+    offsets.assign(num_verts + 1, 0);
+    for (int c = 0; c < num_corners; ++c) {
+        if (valid(c)) offsets[lo(c) + 1]++;
+    }
+    for (int v = 0; v < num_verts; ++v) offsets[v + 1] += offsets[v];
+    bucket.assign(offsets[num_verts], -1);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (int c = 0; c < num_corners; ++c) {
+        if (valid(c)) bucket[fill[lo(c)]++] = c;
+    }
+}
+
+// Pair up the corners of one bucket, see PairCorners.  Buckets share no corner, so different
+// buckets can be processed concurrently.  Return the number of non-manifold edges in the bucket,
+// and append the first corner of each of them to `nonmanifold` if given.
+inline int PairBucket(const std::vector<int> &fvert, int *first, int *last, std::vector<int> &cpair,
+                      std::vector<int> *nonmanifold = nullptr) {
+    auto hi = [&](int c) { return std::max(fvert[c], fvert[CornerNext(c)]); };
+    std::sort(first, last, [&](int a, int b) { return hi(a) != hi(b) ? hi(a) < hi(b) : a < b; });
+    int num_nonmanifold = 0;
+    for (int *run = first; run != last; ) {
+        int *run_end = run + 1;
+        while (run_end != last && hi(*run_end) == hi(*run)) ++run_end;
+        if (run_end - run >= 2) {
+            // among more than two corners, prefer one traversing the edge the other way
+            int *mate = run + 1;
+            while (mate != run_end && fvert[*mate] == fvert[*run]) ++mate;
+            if (mate == run_end) mate = run + 1;
+            cpair[*run] = *mate;
+            cpair[*mate] = *run;
+        }
+        if (run_end - run > 2) {
+            ++num_nonmanifold;
+            if (nonmanifold) nonmanifold->push_back(*run);
+        }
+        run = run_end;
+    }
+    return num_nonmanifold;
+}
+
+// Pair up the corners sharing an (unordered) edge: cpair[c] is the opposite corner, -1 on the boundary.
+// Corners are bucketed by the smaller vertex index of their edge with a counting sort, and each
+// bucket (of about valence size) is sorted by the larger index, so that equal edges are adjacent.
+// If more than two corners share an edge, the first two are paired and the others stay on boundary.
+// Return the number of such non-manifold edges.  Complexity O(F) for bounded valence.
+inline int PairCorners(const std::vector<int> &fvert, int num_verts, std::vector<int> &cpair) {
+    cpair.assign(fvert.size(), -1);
+    std::vector<int> offsets, bucket;
+    BucketCorners(fvert, num_verts, offsets, bucket);
+    int num_nonmanifold = 0;
+    for (int v = 0; v < num_verts; ++v)
+        num_nonmanifold += PairBucket(fvert, bucket.data() + offsets[v], bucket.data() + offsets[v + 1], cpair);
+    return num_nonmanifold;
+}
+
+// Position of every corner among the corners leaving its vertex, for the groups of GroupByLabel: corner
+// `corners[k]` with offsets[v] <= k < offsets[v+1] gets k - offsets[v].  See LabelFans.
+inline void CornerSlots(const std::vector<int> &corners, const std::vector<int> &offsets, std::vector<int> &slot) {
+    slot.resize(corners.size());
+    for (std::size_t v = 0; v + 1 < offsets.size(); ++v) {
+        for (int k = offsets[v]; k < offsets[v + 1]; ++k) slot[corners[k]] = k - offsets[v];
+    }
+}
+
+// Position of corner c in [first, first+n), or -1 if it leaves another vertex.
+inline int CornerSlot(const int *first, int n, const std::vector<int> &slot, int c) {
+    if (c < 0) return -1;
+    const int j = slot[c];
+    return (j < n && first[j] == c) ? j : -1;
+}
+
+// Whether the corners [first, last) of a vertex are all paired and form one cycle around it, i.e. the
+// vertex is interior and has a single fan.  O(valence), see CornerSlots for `slot`.
+inline bool IsSingleCycle(const int *first, const int *last, const std::vector<int> &cpair,
+                          const std::vector<int> &slot) {
+    const int n = int(last - first);
+    int c = first[0];
+    for (int steps = 1; steps <= n; ++steps) {
+        const int d = cpair[CornerPrev(c)];
+        if (CornerSlot(first, n, slot, d) < 0) return false;
+        if (d == first[0]) return steps == n;
+        c = d;
+    }
+    return false;
+}
+
+// Group the corners around vertex v, whose corners (the ones leaving v) are [first, last), into fans:
+// maximal sequences of faces around v linked by paired edges.  A manifold vertex has one fan (a disk
+// or, on the boundary, a half-disk).  The faces must be consistently oriented across paired edges.
+// fan[i] is set to the fan of first[i].  Return the number of fans.  Corners are found among [first, last)
+// through `slot` (see CornerSlots), so the complexity is O(valence).
+inline int LabelFans(const int *first, const int *last, const std::vector<int> &cpair, const std::vector<int> &slot,
+                     std::vector<int> &fan) {
+    const int n = int(last - first);
+    fan.assign(n, -1);
+    int num_fans = 0;
+    for (int i = 0; i < n; ++i) {
+        if (fan[i] >= 0) continue;
+        fan[i] = num_fans;
+        // one way round: the edge entering v in the same face, then across it
+        for (int c = first[i]; ; ) {
+            int d = cpair[CornerPrev(c)];
+            int j = CornerSlot(first, n, slot, d);
+            if (j < 0 || fan[j] >= 0) break;
+            fan[j] = num_fans;
+            c = d;
+        }
+        // the other way round: across the edge leaving v, then the next corner of that face
+        for (int c = first[i]; ; ) {
+            int d = cpair[c] < 0 ? -1 : CornerNext(cpair[c]);
+            int j = CornerSlot(first, n, slot, d);
+            if (j < 0 || fan[j] >= 0) break;
+            fan[j] = num_fans;
+            c = d;
+        }
+        ++num_fans;
+    }
+    return num_fans;
+}
+
+// Reverse the orientation of face g by swapping its last two vertices.
+// The corners (v0,v1,v2) become (v0,v2,v1), thus the new corner 0 is the old corner 2 reversed,
+// and vice versa, while corner 1 stays in place.
+inline void FlipCornerFace(int g, std::vector<int> &fvert, std::vector<int> &cpair) {
+    int c0 = 3*g, c2 = 3*g + 2;
+    std::swap(fvert[c0 + 1], fvert[c2]);
+    std::swap(cpair[c0], cpair[c2]);
+    if (cpair[c0] >= 0) cpair[cpair[c0]] = c0;
+    if (cpair[c2] >= 0) cpair[cpair[c2]] = c2;
+}
+
+// Orient the faces faces[0 .. num_faces) (all faces for nullptr), see OrientCorners.
+// `visited` and `flipped` (optional) hold one entry per face of the mesh.  Calls on sets of faces that
+// share no vertex touch disjoint entries and can run concurrently.
+inline int OrientCornersOf(const int *faces, int num_faces, std::vector<int> &fvert, std::vector<int> &cpair,
+                           std::vector<char> &visited, std::vector<char> *flipped) {
+    std::vector<int> queue;     // flat queue, every face is pushed once
+    queue.reserve(num_faces);
+    int num_conflicts = 0;
+    for (int i = 0; i < num_faces; ++i) {
+        const int seed = faces ? faces[i] : i;
+        if (visited[seed]) continue;
+        visited[seed] = 1;
+        queue.push_back(seed);
+        for (std::size_t head = queue.size() - 1; head < queue.size(); ++head) {
+            int f = queue[head];
+            for (int c = 3*f; c < 3*f + 3; ++c) {
+                int d = cpair[c];
+                if (d < 0) continue;
+                int g = d / 3;
+                bool consistent = fvert[c] == fvert[CornerNext(d)];    // c: a->b, d: b->a
+                if (!visited[g]) {
+                    if (!consistent) {
+                        FlipCornerFace(g, fvert, cpair);
+                        if (flipped) (*flipped)[g] = 1;
+                    }
+                    visited[g] = 1;
+                    queue.push_back(g);
+                } else if (!consistent) {
+                    ++num_conflicts;
+                }
+            }
+        }
+    }
+    return num_conflicts / 2;   // every conflicting edge is seen from both sides
+}
+
+// Flip faces so that every edge is traversed in opposite directions by its two faces.
+// Faces are visited in a BFS manner from a seed face, whose orientation is kept; every connected
+// component gets its own seed.  https://en.wikipedia.org/wiki/Breadth-first_search
+// Faces that were flipped are marked in `flipped` if given.  Return the number of edges whose
+// faces cannot be oriented consistently (non-orientable surfaces).  Complexity O(F).
+inline int OrientCorners(std::vector<int> &fvert, std::vector<int> &cpair, std::vector<char> *flipped = nullptr) {
+    const int num_faces = int(fvert.size() / 3);
+    std::vector<char> visited(num_faces, 0);
+    if (flipped) flipped->assign(num_faces, 0);
+    return OrientCornersOf(nullptr, num_faces, fvert, cpair, visited, flipped);
+}
+
+#endif // LEOYOLO_MESHTOPOLOGY_H
@@ -0,0 +1,142 @@
+//
+// Result of TriMesh::Validate and the parallel helpers it is built from.
+// Unlike the asserts of TriMesh, validation also runs in release builds and reports every
+// offending element instead of stopping at the first one.
+//
+
+#ifndef LEOYOLO_MESHVALIDATE_H
+#define LEOYOLO_MESHVALIDATE_H
+
+#include "common.h"
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <stddef.h>
+
+// Kinds of violated invariants.  The element of an issue is its position in the edge, vertex or face
+// list of the mesh, except for duplicate ids where it is the id itself.
+enum class MeshIssue {
+    Tables,             // out edge or corner table not built for the current elements (element -1)
+    EdgeId,             // id not equal to the position in the edge list (ids are dense, see TriMesh::NewEdgeIds)
+    EdgePair,           // pair missing, pair->pair != e, or e paired with itself
+    EdgeVertex,         // end vertex missing, not in the mesh, or equal to the start vertex
+    EdgeLoop,           // next/prev not inverse of each other, loop not a triangle, or leaving the face
+    EdgeBoundary,       // half-edge without face but with next or prev
+    Orientation,        // e and its pair do not run opposite ways: e->prev->vert != e->pair->vert
+    VertexIndex,        // index not equal to the position in the vertex list
+    VertexEdge,         // edge not an out edge of the vertex
+    VertexBoundary,     // boundary vertex not pointing to the out edge whose pair is on boundary
+    OutEdges,           // walk around the vertex misses out edges of the table or leaves the vertex
+    FaceEdge,           // edge missing or not bordering the face
+    FaceVertices,       // vertid or the corner table disagree with the half-edges
+    DuplicateVertexId,
+    DuplicateFaceId
+};
+
+const int kNumMeshIssues = int(MeshIssue::DuplicateFaceId) + 1;
+
+inline const char *MeshIssueName(MeshIssue issue) {
+    static const char *const names[kNumMeshIssues] = {
+        "tables", "edge id", "edge pair", "edge vertex", "edge loop", "edge boundary", "orientation",
+        "vertex index", "vertex edge", "vertex boundary", "out edges", "face edge", "face vertices",
+        "duplicate vertex id", "duplicate face id"
+    };
+    return names[int(issue)];
+}
+
+struct ValidationResult {
+    std::vector<std::pair<MeshIssue, int>> issues;     // sorted by kind, then element
+    bool canceled;      // stopped through the progress callback, the issues are incomplete
+
+    ValidationResult() : issues(), canceled(false) {}
+
+    bool IsValid() const {
+        return !canceled && issues.empty();
+    }
+
+    std::size_t Count(MeshIssue issue) const {
+        return std::count_if(issues.begin(), issues.end(),
+                             [issue](const std::pair<MeshIssue, int> &i) { return i.first == issue; });
+    }
+
+    // Offending elements of one kind.
+    std::vector<int> Elements(MeshIssue issue) const {
+        std::vector<int> elements;
+        for (const auto &i : issues)
+            if (i.first == issue) elements.push_back(i.second);
+        return elements;
+    }
+
+    // One line per kind found, with its first few elements.
+    void Print(std::size_t max_elements = 8) const {
+        printf("ValidationResult: %d issues%s.\n", (int)issues.size(), canceled ? ", canceled" : "");
+        for (std::size_t i = 0; i < issues.size(); ) {
+            std::size_t j = i;
+            while (j < issues.size() && issues[j].first == issues[i].first) ++j;
+            printf("  %s: %d,", MeshIssueName(issues[i].first), int(j - i));
+            for (std::size_t k = i; k < j && k < i + max_elements; ++k) printf(" %d", issues[k].second);
+            printf(j - i > max_elements ? " ...\n" : "\n");
+            i = j;
+        }
+    }
+};
+
+// Issues found by the threads of a sweep, one list per thread so that no locking is needed.
+struct IssueCollector {
+    std::vector<std::vector<std::pair<MeshIssue, int>>> lists;
+
+    explicit IssueCollector(int threads) : lists(threads) {}
+
+    void Add(int thread, MeshIssue issue, int element) {
+        lists[thread].push_back(std::make_pair(issue, element));
+    }
+
+    void MergeInto(ValidationResult &result) {
+        for (auto &list : lists) result.issues.insert(result.issues.end(), list.begin(), list.end());
+        std::sort(result.issues.begin(), result.issues.end());
+        result.issues.erase(std::unique(result.issues.begin(), result.issues.end()), result.issues.end());
+        lists.assign(lists.size(), std::vector<std::pair<MeshIssue, int>>());
+    }
+};
+
+// Append the ids occurring more than once among id(0) .. id(n-1) to `dups`, each once and in increasing
+// order.  Ids in a compact range (the usual 1..n of m-files) are marked in a flag table in parallel,
+// other ones are sorted.
+template <typename GetId>
+inline void FindDuplicateIds(std::size_t n, GetId id, int threads, std::vector<int> &dups) {
+    if (n < 2) return;
+    std::vector<int> lo(threads, id(0)), hi(threads, id(0));
+    ParallelFor(0, n, [&](std::size_t b, std::size_t e, int t) {
+        for (std::size_t i = b; i < e; ++i) {
+            lo[t] = MIN(lo[t], id(i));
+            hi[t] = MAX(hi[t], id(i));
+        }
+    }, threads);
+    const long long min_id = *std::min_element(lo.begin(), lo.end());
+    const long long range = *std::max_element(hi.begin(), hi.end()) - min_id + 1;
+    std::vector<int> found;
+    if (range <= 4 * (long long)n + 64) {
+        std::unique_ptr<std::atomic<unsigned char>[]> seen(new std::atomic<unsigned char>[range]());
+        std::vector<std::vector<int>> lists(threads);
+        ParallelFor(0, n, [&](std::size_t b, std::size_t e, int t) {
+            for (std::size_t i = b; i < e; ++i) {
+                if (seen[id(i) - min_id].exchange(1, std::memory_order_relaxed)) lists[t].push_back(id(i));
+            }
+        }, threads);
+        for (const auto &list : lists) found.insert(found.end(), list.begin(), list.end());
+        std::sort(found.begin(), found.end());
+    } else {
+        std::vector<int> ids(n);
+        for (std::size_t i = 0; i < n; ++i) ids[i] = id(i);
+        std::sort(ids.begin(), ids.end());
+        for (std::size_t i = 1; i < n; ++i)
+            if (ids[i] == ids[i - 1]) found.push_back(ids[i]);
+    }
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    dups.insert(dups.end(), found.begin(), found.end());
+}
+
+#endif // LEOYOLO_MESHVALIDATE_H
@@ -8,7 +8,7 @@ QT       += core gui opengl
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += console
+CONFIG += console c++17
 
 TARGET = MeshViewer
 TEMPLATE = app
@@ -16,13 +16,34 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    openglwindow.cpp
+    openglwindow.cpp \
+    meshbuffers.cpp \
+    decorationbuffer.cpp \
+    glstatecache.cpp \
+    frameprofiler.cpp \
+    adaptivequality.cpp \
+    meshloader.cpp
 
 HEADERS  += mainwindow.h \
     openglwindow.h \
+    meshbuffers.h \
+    decorationbuffer.h \
+    glstatecache.h \
+    frameprofiler.h \
+    adaptivequality.h \
+    meshloader.h \
     common.h \
     TriMesh.h \
+    MeshTopology.h \
+    MeshNormals.h \
+    MeshValidate.h \
+    CompactMesh.h \
+    MemoryPool.h \
     MParser.h \
+    MappedFile.h \
+    MeshCache.h \
+    Simplify.h \
+    BVH.h \
     arcball.h
 
 FORMS    += mainwindow.ui
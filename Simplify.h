@@ -0,0 +1,448 @@
+//
+// Quadric error metric simplification (Garland and Heckbert) by edge collapse, and chains of levels of
+// detail built with it.
+// The decimator starts from the connectivity of a TriMesh: its corner table, and its half-edges without
+// face for the boundary.  The collapses themselves run on flat arrays (positions, triangles, faces around
+// each vertex), so the source mesh is only read and can be on screen meanwhile.  The result is a new TriMesh.
+//
+
+#ifndef LEOYOLO_SIMPLIFY_H
+#define LEOYOLO_SIMPLIFY_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <math.h>
+#include "common.h"
+#include "TriMesh.h"
+
+// Sum of squared distances to a set of weighted planes, as the upper triangle of the symmetric 4x4 matrix
+// [A b; b^T c], so that the error at x is x^T A x + 2 b^T x + c.
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+
+    Quadric() : a00(0.), a01(0.), a02(0.), a11(0.), a12(0.), a22(0.), b0(0.), b1(0.), b2(0.), c(0.) {}
+
+    // Plane n.x + d = 0 with unit normal n, weighted by w.
+    static Quadric Plane(double nx, double ny, double nz, double d, double w) {
+        Quadric q;
+        q.a00 = w*nx*nx; q.a01 = w*nx*ny; q.a02 = w*nx*nz;
+        q.a11 = w*ny*ny; q.a12 = w*ny*nz; q.a22 = w*nz*nz;
+        q.b0 = w*nx*d; q.b1 = w*ny*d; q.b2 = w*nz*d;
+        q.c = w*d*d;
+        return q;
+    }
+
+    void Add(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+    }
+
+    double Error(double x, double y, double z) const {
+        return a00*x*x + 2.*a01*x*y + 2.*a02*x*z + a11*y*y + 2.*a12*y*z + a22*z*z
+               + 2.*(b0*x + b1*y + b2*z) + c;
+    }
+
+    // Point of least error, solving A x = -b.  Return false if A is close to singular, e.g. for planes
+    // that are all parallel or meet in a line.
+    bool Optimum(double p[3]) const {
+        const double c00 = a11*a22 - a12*a12, c01 = a02*a12 - a01*a22, c02 = a01*a12 - a02*a11;
+        const double det = a00*c00 + a01*c01 + a02*c02;
+        const double scale = a00 + a11 + a22;
+        if (fabs(det) <= 1e-10 * scale*scale*scale || scale <= 0.) return false;
+        const double c11 = a00*a22 - a02*a02, c12 = a01*a02 - a00*a12, c22 = a00*a11 - a01*a01;
+        p[0] = -(c00*b0 + c01*b1 + c02*b2) / det;
+        p[1] = -(c01*b0 + c11*b1 + c12*b2) / det;
+        p[2] = -(c02*b0 + c12*b1 + c22*b2) / det;
+        return true;
+    }
+};
+
+// Edge collapse decimator.  The cost of an edge is the error of collapsing it to the point of least error
+// of the summed quadrics of its vertices.  Edges are collapsed cheapest first from a queue that is rebuilt
+// in passes, rather than kept as a heap whose updates would miss the cache on every level: a pass costs
+// all live edges in parallel, orders the cheapest 1/kPassDivisor of them and collapses them in that order.
+// An edge whose vertex has already been changed in the pass is stale and left to the next pass, which
+// costs it anew.
+// A collapse is rejected when it would
+// - break the link condition: the vertices share a neighbor other than the tips of the faces on the edge,
+//   which would make the mesh non-manifold,
+// - pinch the surface: an interior edge between two boundary vertices, or a component that is too small,
+// - fold a face over: its normal turns by more than about 80 degrees.
+// Boundary edges keep their place through planes perpendicular to the surface, added to the quadrics with
+// kBoundaryWeight.
+class QuadricSimplifier {
+public:
+    // Relative weight of the boundary planes.
+    static constexpr double kBoundaryWeight = 100.;
+    // Smallest cosine between the normals of a face before and after a collapse.
+    static constexpr double kMinFaceCosine = 0.2;
+    static constexpr int kPassDivisor = 4;
+
+    // Quadrics and the queue are computed on `num_threads` threads (0 for NumThreads()).
+    explicit QuadricSimplifier(TriMesh &mesh, int num_threads = 0);
+
+    std::size_t NumFaces() const { return m_num_faces; }
+
+    // Collapse edges until at most `target_faces` faces are left or no collapse is allowed anymore.
+    // `progress` gets the fraction of the collapses needed and may return false to cancel, in which case
+    // false is returned.  Can be called again with a smaller target to continue.
+    bool SimplifyTo(std::size_t target_faces, const ProgressCallback &progress = ProgressCallback());
+
+    // The current state as a new mesh.  Vertices and faces keep the ids of the source mesh.
+    std::shared_ptr<TriMesh> Extract() const;
+
+private:
+    struct Entry {
+        float cost;
+        int a, b;
+        bool operator<(const Entry &other) const { return cost < other.cost; }
+    };
+
+    const float *Pos(int v) const { return &m_pos[3*v]; }
+    // Point to collapse (a, b) to and the error there.
+    double Target(int a, int b, double p[3]) const;
+    // Every live edge once with its cost: from the face where it runs from the smaller to the larger
+    // vertex, or from its only face on the boundary.
+    void CollectEdges(std::vector<Entry> &edges) const;
+    bool OnlyFace(int u, int v) const;
+    bool Collapse(int a, int b);
+    // Rewrite the face lists of the live vertices without dead faces once they have grown too much.
+    void CompactRefs();
+
+private:
+    std::vector<float> m_pos;           // 3 per vertex
+    std::vector<int> m_tri;             // 3 per face
+    std::vector<int> m_vert_ids, m_face_ids;
+    std::vector<Quadric> m_quadric;
+    std::vector<int> m_changed;         // pass in which the vertex last took part in a collapse
+    std::vector<char> m_boundary;
+    std::vector<char> m_vert_dead, m_face_dead;
+    std::vector<int> m_ref_start, m_ref_count;  // faces of v at m_refs[start .. start+count), dead ones included
+    std::vector<int> m_refs;
+    std::vector<int> m_mark;            // scratch, compared with m_mark_stamp
+    int m_mark_stamp;
+    int m_pass;
+    int m_threads;
+    std::size_t m_num_faces;            // alive
+    std::size_t m_compact_size;         // m_refs size at which CompactRefs runs
+};
+
+inline QuadricSimplifier::QuadricSimplifier(TriMesh &mesh, int num_threads)
+    : m_mark_stamp(0), m_pass(0), m_threads(1), m_num_faces(mesh.NumFaces()), m_compact_size(0)
+{
+    const int num_verts = int(mesh.NumVertices()), num_faces = int(mesh.NumFaces());
+    const int threads = MIN<int>(NumThreads(num_threads), (num_verts + num_faces) / 65536 + 1);
+    m_threads = threads;
+    m_pos.resize(3 * std::size_t(num_verts));
+    m_vert_ids.resize(num_verts);
+    m_face_ids.resize(num_faces);
+    ParallelFor(0, num_verts, [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t i = b; i < e; ++i) {
+            const HE_vert *v = mesh.GetVertex(i);
+            m_pos[3*i] = v->x; m_pos[3*i + 1] = v->y; m_pos[3*i + 2] = v->z;
+            m_vert_ids[i] = v->id;
+        }
+    }, threads);
+    for (int f = 0; f < num_faces; ++f) m_face_ids[f] = mesh.GetFace(f)->id;
+    m_tri = mesh.GetTriangles();
+    m_changed.assign(num_verts, 0);
+    m_boundary.assign(num_verts, 0);
+    m_vert_dead.assign(num_verts, 0);
+    m_face_dead.assign(num_faces, 0);
+    m_mark.assign(num_verts, 0);
+
+    // faces around each vertex
+    m_ref_count.assign(num_verts, 0);
+    for (int v : m_tri) m_ref_count[v]++;
+    m_ref_start.resize(num_verts);
+    int offset = 0;
+    for (int v = 0; v < num_verts; ++v) {
+        m_ref_start[v] = offset;
+        offset += m_ref_count[v];
+    }
+    m_refs.resize(offset);
+    std::vector<int> fill(m_ref_start);
+    for (std::size_t c = 0; c < m_tri.size(); ++c) m_refs[fill[m_tri[c]]++] = int(c / 3);
+    m_compact_size = 2 * m_refs.size() + 1024;
+
+    // the area weighted planes of the faces around each vertex, every vertex on its own
+    m_quadric.resize(num_verts);
+    ParallelFor(0, num_verts, [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t v = b; v < e; ++v) {
+            Quadric q;
+            for (int i = m_ref_start[v]; i < m_ref_start[v] + m_ref_count[v]; ++i) {
+                const int *t = &m_tri[3 * m_refs[i]];
+                const float *p0 = Pos(t[0]), *p1 = Pos(t[1]), *p2 = Pos(t[2]);
+                const double ux = p1[0]-p0[0], uy = p1[1]-p0[1], uz = p1[2]-p0[2];
+                const double wx = p2[0]-p0[0], wy = p2[1]-p0[1], wz = p2[2]-p0[2];
+                double nx = uy*wz - uz*wy, ny = uz*wx - ux*wz, nz = ux*wy - uy*wx;
+                const double len = sqrt(nx*nx + ny*ny + nz*nz);
+                if (len <= 0.) continue;
+                nx /= len; ny /= len; nz /= len;
+                q.Add(Quadric::Plane(nx, ny, nz, -(nx*p0[0] + ny*p0[1] + nz*p0[2]), 0.5 * len));
+            }
+            m_quadric[v] = q;
+        }
+    }, threads);
+
+    // boundary planes through each boundary edge, perpendicular to its face
+    for (auto it = mesh.GetEdgesBegin(); it != mesh.GetEdgesEnd(); ++it) {
+        const HE_edge *e = *it;
+        if (e->face != nullptr || !e->pair || !e->pair->face) continue;
+        const HE_face *f = e->pair->face;
+        const int a = e->pair->vert->index, b = e->vert->index;
+        m_boundary[a] = m_boundary[b] = 1;
+        const float *pa = Pos(a), *pb = Pos(b);
+        const double dx = pb[0]-pa[0], dy = pb[1]-pa[1], dz = pb[2]-pa[2];
+        double nx = dy*f->nz - dz*f->ny, ny = dz*f->nx - dx*f->nz, nz = dx*f->ny - dy*f->nx;
+        const double len = sqrt(nx*nx + ny*ny + nz*nz);
+        if (len <= 0.) continue;
+        nx /= len; ny /= len; nz /= len;
+        const Quadric q = Quadric::Plane(nx, ny, nz, -(nx*pa[0] + ny*pa[1] + nz*pa[2]),
+                                         kBoundaryWeight * (dx*dx + dy*dy + dz*dz));
+        m_quadric[a].Add(q);
+        m_quadric[b].Add(q);
+    }
+}
+
+// The point of least error if there is one, otherwise the better of the end points and the midpoint.
+inline double QuadricSimplifier::Target(int a, int b, double p[3]) const {
+    Quadric q = m_quadric[a];
+    q.Add(m_quadric[b]);
+    if (q.Optimum(p)) return q.Error(p[0], p[1], p[2]);
+    const float *pa = Pos(a), *pb = Pos(b);
+    double best = -1.;
+    for (int k = 0; k < 3; ++k) {
+        const double t = 0.5 * k;
+        const double x = pa[0] + t*(pb[0]-pa[0]), y = pa[1] + t*(pb[1]-pa[1]), z = pa[2] + t*(pb[2]-pa[2]);
+        const double err = q.Error(x, y, z);
+        if (best < 0. || err < best) {
+            best = err;
+            p[0] = x; p[1] = y; p[2] = z;
+        }
+    }
+    return best;
+}
+
+// Only boundary edges are in a single live face.
+inline bool QuadricSimplifier::OnlyFace(int u, int v) const {
+    int count = 0;
+    for (int i = m_ref_start[u]; i < m_ref_start[u] + m_ref_count[u]; ++i) {
+        const int *t = &m_tri[3 * m_refs[i]];
+        if (!m_face_dead[m_refs[i]] && (t[0] == v || t[1] == v || t[2] == v)) ++count;
+    }
+    return count == 1;
+}
+
+inline void QuadricSimplifier::CollectEdges(std::vector<Entry> &edges) const {
+    std::vector<std::vector<Entry>> lists(m_threads);
+    ParallelFor(0, m_face_dead.size(), [&](std::size_t b, std::size_t e, int t) {
+        double p[3];
+        for (std::size_t f = b; f < e; ++f) {
+            if (m_face_dead[f]) continue;
+            for (int k = 0; k < 3; ++k) {
+                const int u = m_tri[3*f + k], v = m_tri[3*f + (k + 1) % 3];
+                if (u > v && !(m_boundary[u] && m_boundary[v] && OnlyFace(u, v))) continue;
+                lists[t].push_back(Entry{float(MAX(0., Target(u, v, p))), u, v});
+            }
+        }
+    }, m_threads);
+    edges.clear();
+    for (const auto &list : lists) edges.insert(edges.end(), list.begin(), list.end());
+}
+
+inline bool QuadricSimplifier::SimplifyTo(std::size_t target_faces, const ProgressCallback &progress) {
+    const std::size_t start = m_num_faces;
+    std::vector<Entry> edges;
+    bool take_all = false;  // the last pass could not collapse any of the cheapest edges
+    while (m_num_faces > target_faces) {
+        if (progress && !progress(float(start - m_num_faces) / float(start - target_faces))) return false;
+        CollectEdges(edges);
+        // an interior collapse removes two faces
+        const std::size_t needed = (m_num_faces - target_faces + 1) / 2;
+        const std::size_t count = take_all ? edges.size() : MIN(edges.size(), MAX(needed, edges.size() / kPassDivisor + 1));
+        if (count == 0) break;
+        std::nth_element(edges.begin(), edges.begin() + (count - 1), edges.end());
+        std::sort(edges.begin(), edges.begin() + count);
+        const std::size_t before = m_num_faces;
+        ++m_pass;
+        for (std::size_t i = 0; i < count && m_num_faces > target_faces; ++i) {
+            if (progress && (i & 0xffff) == 0xffff &&
+                !progress(float(start - m_num_faces) / float(start - target_faces)))
+                return false;
+            const Entry &edge = edges[i];
+            if (m_changed[edge.a] == m_pass || m_changed[edge.b] == m_pass) continue;   // stale
+            Collapse(edge.a, edge.b);
+        }
+        if (m_num_faces == before) {
+            if (take_all || count == edges.size()) break;   // no collapse is allowed anymore
+            take_all = true;
+        } else {
+            take_all = false;
+        }
+        if (m_refs.size() > m_compact_size) CompactRefs();
+    }
+    if (progress) progress(1.f);
+    return true;
+}
+
+// Collapse b into a, see the class comment for when it is rejected.
+inline bool QuadricSimplifier::Collapse(int a, int b) {
+    // link condition
+    const int stamp = ++m_mark_stamp;
+    int tips[2], num_shared = 0, num_faces = 0;
+    for (int i = m_ref_start[a]; i < m_ref_start[a] + m_ref_count[a]; ++i) {
+        const int f = m_refs[i];
+        if (m_face_dead[f]) continue;
+        ++num_faces;
+        const int *t = &m_tri[3*f];
+        const bool shared = t[0] == b || t[1] == b || t[2] == b;
+        for (int k = 0; k < 3; ++k) {
+            if (t[k] == a || t[k] == b) continue;
+            m_mark[t[k]] = stamp;
+            if (shared) {
+                if (num_shared == 2) return false;  // a non-manifold edge
+                tips[num_shared++] = t[k];
+            }
+        }
+    }
+    if (num_shared == 0) return false;
+    if (num_shared == 2 && m_boundary[a] && m_boundary[b]) return false;
+    for (int i = m_ref_start[b]; i < m_ref_start[b] + m_ref_count[b]; ++i) {
+        const int f = m_refs[i];
+        if (m_face_dead[f]) continue;
+        ++num_faces;
+        const int *t = &m_tri[3*f];
+        for (int k = 0; k < 3; ++k) {
+            const int v = t[k];
+            if (v == a || v == b || m_mark[v] != stamp) continue;
+            if (v != tips[0] && (num_shared < 2 || v != tips[1])) return false;
+        }
+    }
+    const int remaining = num_faces - 2 * num_shared;
+    if (remaining < (num_shared == 2 ? 3 : 1)) return false;  // e.g. a tetrahedron or a lone triangle
+
+    // no face may fold over
+    double p[3];
+    Target(a, b, p);
+    for (int s = 0; s < 2; ++s) {
+        const int u = s == 0 ? a : b;
+        for (int i = m_ref_start[u]; i < m_ref_start[u] + m_ref_count[u]; ++i) {
+            const int f = m_refs[i];
+            if (m_face_dead[f]) continue;
+            const int *t = &m_tri[3*f];
+            if ((t[0] == a || t[1] == a || t[2] == a) && (t[0] == b || t[1] == b || t[2] == b)) continue;
+            const int k = t[0] == u ? 0 : (t[1] == u ? 1 : 2);
+            const float *p1 = Pos(t[(k + 1) % 3]), *p2 = Pos(t[(k + 2) % 3]), *p0 = Pos(u);
+            const double ex = p2[0]-p1[0], ey = p2[1]-p1[1], ez = p2[2]-p1[2];
+            const double ux = p0[0]-p1[0], uy = p0[1]-p1[1], uz = p0[2]-p1[2];
+            const double vx = p[0]-p1[0], vy = p[1]-p1[1], vz = p[2]-p1[2];
+            const double n0x = ey*uz - ez*uy, n0y = ez*ux - ex*uz, n0z = ex*uy - ey*ux;
+            const double n1x = ey*vz - ez*vy, n1y = ez*vx - ex*vz, n1z = ex*vy - ey*vx;
+            const double dot = n0x*n1x + n0y*n1y + n0z*n1z;
+            const double len2 = (n0x*n0x + n0y*n0y + n0z*n0z) * (n1x*n1x + n1y*n1y + n1z*n1z);
+            if (dot <= 0. || dot*dot < kMinFaceCosine*kMinFaceCosine*len2) return false;
+        }
+    }
+
+    // b goes into a, the faces on the edge die and the others of b now use a
+    const int start = int(m_refs.size());
+    for (int s = 0; s < 2; ++s) {
+        const int u = s == 0 ? a : b;
+        for (int i = m_ref_start[u]; i < m_ref_start[u] + m_ref_count[u]; ++i) {
+            const int f = m_refs[i];
+            if (m_face_dead[f]) continue;
+            int *t = &m_tri[3*f];
+            if (u == b) {
+                if (t[0] == a || t[1] == a || t[2] == a) {
+                    m_face_dead[f] = 1;
+                    --m_num_faces;
+                    continue;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    if (t[k] == b) t[k] = a;
+                }
+            } else if (t[0] == b || t[1] == b || t[2] == b) {
+                continue;   // killed when visited from b
+            }
+            m_refs.push_back(f);
+        }
+    }
+    m_ref_start[a] = start;
+    m_ref_count[a] = int(m_refs.size()) - start;
+    m_ref_count[b] = 0;
+    m_pos[3*a] = float(p[0]); m_pos[3*a + 1] = float(p[1]); m_pos[3*a + 2] = float(p[2]);
+    m_quadric[a].Add(m_quadric[b]);
+    m_boundary[a] = m_boundary[a] || m_boundary[b];
+    m_vert_dead[b] = 1;
+    m_changed[a] = m_changed[b] = m_pass;   // the edges around a have a new cost
+    return true;
+}
+
+inline void QuadricSimplifier::CompactRefs() {
+    std::vector<int> refs;
+    refs.reserve(3 * m_num_faces);
+    for (std::size_t v = 0; v < m_ref_start.size(); ++v) {
+        const int start = int(refs.size());
+        for (int i = m_ref_start[v]; i < m_ref_start[v] + m_ref_count[v]; ++i) {
+            if (!m_face_dead[m_refs[i]]) refs.push_back(m_refs[i]);
+        }
+        m_ref_start[v] = start;
+        m_ref_count[v] = int(refs.size()) - start;
+    }
+    m_refs.swap(refs);
+    m_compact_size = 2 * m_refs.size() + 1024;
+}
+
+inline std::shared_ptr<TriMesh> QuadricSimplifier::Extract() const {
+    std::vector<char> used(m_vert_dead.size(), 0);
+    for (std::size_t f = 0; f < m_face_dead.size(); ++f) {
+        if (m_face_dead[f]) continue;
+        for (int k = 0; k < 3; ++k) used[m_tri[3*f + k]] = 1;
+    }
+    std::size_t num_verts = 0;
+    for (char u : used) num_verts += u;
+    std::shared_ptr<TriMesh> mesh = std::make_shared<TriMesh>();
+    mesh->Reserve(num_verts, m_num_faces);
+    for (std::size_t v = 0; v < used.size(); ++v) {
+        if (used[v]) mesh->InsertVertex(m_pos[3*v], m_pos[3*v + 1], m_pos[3*v + 2], m_vert_ids[v]);
+    }
+    for (std::size_t f = 0; f < m_face_dead.size(); ++f) {
+        if (m_face_dead[f]) continue;
+        const int *t = &m_tri[3*f];
+        mesh->InsertFace(m_face_ids[f], m_vert_ids[t[0]], m_vert_ids[t[1]], m_vert_ids[t[2]]);
+    }
+    mesh->Update(BuildMode::Tolerant);     // collapses keep the mesh manifold, this only guards against surprises
+    if (!mesh->GetBuildReport().IsClean()) mesh->GetBuildReport().Print();
+    return mesh;
+}
+
+// Levels of detail of `mesh` with the given fractions of its faces, finest first, e.g. {0.5, 0.25, 0.1, 0.02}.
+// A single decimation runs through all of them, so each level only costs the collapses since the previous
+// one.  A level is left out when it could not get below the previous one.  `progress` is as in
+// QuadricSimplifier::SimplifyTo, over the whole chain; if it cancels, nothing is returned.
+inline std::vector<std::shared_ptr<TriMesh>> BuildLodChain(TriMesh &mesh, const std::vector<float> &fractions,
+                                                           const ProgressCallback &progress = ProgressCallback(),
+                                                           int num_threads = 0) {
+    std::vector<std::shared_ptr<TriMesh>> lods;
+    if (fractions.empty() || mesh.NumFaces() == 0) return lods;
+    QuadricSimplifier simplifier(mesh, num_threads);
+    const float total = 1.f - fractions.back();
+    float done = 0.f;
+    for (float fraction : fractions) {
+        const std::size_t before = simplifier.NumFaces();
+        const float share = 1.f - fraction - done;
+        ProgressCallback report;
+        if (progress) report = [&](float f) { return progress((done + f * share) / total); };
+        if (!simplifier.SimplifyTo(std::size_t(fraction * mesh.NumFaces()), report)) return {};
+        done = 1.f - fraction;
+        if (simplifier.NumFaces() < before) lods.push_back(simplifier.Extract());
+    }
+    return lods;
+}
+
+#endif // LEOYOLO_SIMPLIFY_H
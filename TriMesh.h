@@ -8,17 +8,19 @@
 
 #include <vector>
 #include <stdio.h>
-#include <map>
-#include <atomic>
 #include <memory>
-#include <forward_list>
 #include <assert.h>
 #include <array>
-#include <set>
 #include <algorithm>
-#include <queue>
+#include <utility>
+#include <iterator>
 #include <stdexcept>
 #include <math.h>
+#include "common.h"
+#include "MeshTopology.h"
+#include "MeshNormals.h"
+#include "MeshValidate.h"
+#include "MemoryPool.h"
 
 // forward declaration
 struct HE_edge;
@@ -40,11 +42,11 @@ struct HE_vert {
 	float x, y, z;  // vertex coordinates
     float nx, ny, nz; // vertex normals
 	HE_edge *edge; // one of the half-edges emanating from the vertex
-	std::forward_list<HE_edge*> out_edge;	// for the ease of edge look-up
 	int id;         // id of an vertex
+	int index;      // position in the vertex list of the mesh, also the row in its out edge table
 
-    HE_vert() : x(0.f), y(0.f), z(0.f), nx(0.f), ny(0.f), nz(0.f), edge(nullptr), out_edge(), id(-1) {}
-    void ComputeNormal();       // forward declaration
+    HE_vert() : x(0.f), y(0.f), z(0.f), nx(0.f), ny(0.f), nz(0.f), edge(nullptr), id(-1), index(-1) {}
+    void ComputeNormal(HE_edge *const *out_begin, HE_edge *const *out_end);   // forward declaration
 };
 
 struct HE_face {
@@ -57,24 +59,33 @@ struct HE_face {
     void ComputeNormal();
 };
 
-void HE_vert::ComputeNormal() {
-    assert(edge && !out_edge.empty() && "HE_vert.ComputeNormal: Edges are not initialized.");
-    for (auto it = out_edge.begin(); it != out_edge.end(); ++it) {
-        if (!(*it)->face) continue; // edge is on boundary
-        nx += (*it)->face->nx;
-        ny += (*it)->face->ny;
-        nz += (*it)->face->nz;
+// [out_begin, out_end) are the half-edges emanating from the vertex, see TriMesh::GetOutEdgeTable.
+// Uniform weighting of the face normals, which must be up to date.  See MeshNormals.h for degenerate cases.
+inline void HE_vert::ComputeNormal(HE_edge *const *out_begin, HE_edge *const *out_end) {
+    assert(edge && out_begin != out_end && "HE_vert.ComputeNormal: Edges are not initialized.");
+    nx = ny = nz = 0.f;
+    int count = 0;
+    for (auto it = out_begin; it != out_end; ++it) {
+        HE_face *f = (*it)->face;
+        if (!f || (f->nx == 0.f && f->ny == 0.f && f->nz == 0.f)) continue; // boundary or degenerate face
+        nx += f->nx;
+        ny += f->ny;
+        nz += f->nz;
+        ++count;
     }
     float norm = sqrt(nx*nx + ny*ny + nz*nz);
-    if (norm < 1e-5) {
-        return; // TODO: handle degraded triangle
+    if (norm <= kDegenerateNormal * count) {
+        nx = 0.f;
+        ny = 0.f;
+        nz = 1.f;
+        return;
     }
     nx /= norm;
     ny /= norm;
     nz /= norm;
 }
 
-void HE_face::ComputeNormal() {
+inline void HE_face::ComputeNormal() {
     assert(edge && "HE_face.ComputeNormal: Edges around the face are not initialized.");
     assert(edge->vert == edge->next->pair->vert &&
            "HE_face.ComputeNormal: Incorrect face orientation.");
@@ -91,151 +102,448 @@ void HE_face::ComputeNormal() {
     ny = vec1[0]*vec2[2] - vec1[2]*vec2[0];
     nz = vec2[0]*vec1[1] - vec2[1]*vec1[0];
     float norm = sqrt(nx*nx + ny*ny + nz*nz);
-    if (norm < 1e-5) {
-        return; // TODO: handle degraded triangle
+    float scale = vec1[0]*vec1[0] + vec1[1]*vec1[1] + vec1[2]*vec1[2] + vec2[0]*vec2[0] + vec2[1]*vec2[1] + vec2[2]*vec2[2];
+    if (norm <= kDegenerateNormal * scale) {
+        nx = ny = nz = 0.f;     // degenerate triangle, see MeshNormals.h
+        return;
     }
     nx /= norm;
     ny /= norm;
     nz /= norm;
 }
 
+// Walks the half-edges of a face loop or of the one-ring of a vertex in place, without allocating.
+// The walk ends when it comes back to the start or runs into the boundary.  A default constructed
+// circulator is the end of every walk.
+class HalfEdgeCirculator {
+public:
+    enum Mode {
+        FaceLoop,       // e, e->next, ... around a face
+        VertexRing,     // out edges e, e->pair->next, ... around a vertex
+        BoundaryRing    // out edges e, e->prev->pair, ... from the out edge whose pair is on boundary
+    };
+
+    HalfEdgeCirculator() : m_start(nullptr), m_cur(nullptr), m_mode(FaceLoop) {}
+    HalfEdgeCirculator(HE_edge *start, Mode mode) : m_start(start), m_cur(start), m_mode(mode) {}
+
+    HE_edge *operator*() const { return m_cur; }
+
+    HalfEdgeCirculator &operator++() {
+        HE_edge *next;
+        if (m_mode == FaceLoop)
+            next = m_cur->next;
+        else if (m_mode == VertexRing)
+            next = m_cur->pair->next;
+        else
+            next = m_cur->prev ? m_cur->prev->pair : nullptr;
+        m_cur = (next == m_start) ? nullptr : next;
+        return *this;
+    }
+
+    bool operator==(const HalfEdgeCirculator &other) const { return m_cur == other.m_cur; }
+    bool operator!=(const HalfEdgeCirculator &other) const { return m_cur != other.m_cur; }
+
+private:
+    HE_edge *m_start;
+    HE_edge *m_cur;
+    Mode m_mode;
+};
+
+// Projections of the walked half-edges, see ElementCirculator.
+struct HalfEdgeOf {
+    typedef HE_edge *Type;
+    static bool Keep(const HE_edge *) { return true; }
+    static Type Get(HE_edge *e) { return e; }
+};
+struct PairOf {
+    typedef HE_edge *Type;
+    static bool Keep(const HE_edge *) { return true; }
+    static Type Get(HE_edge *e) { return e->pair; }
+};
+struct VertOf {         // vertex at the end of the half-edge
+    typedef HE_vert *Type;
+    static bool Keep(const HE_edge *) { return true; }
+    static Type Get(HE_edge *e) { return e->vert; }
+};
+struct FaceOf {         // boundary half-edges are skipped
+    typedef HE_face *Type;
+    static bool Keep(const HE_edge *e) { return e->face != nullptr; }
+    static Type Get(HE_edge *e) { return e->face; }
+};
+struct PairFaceOf {     // face across the half-edge, boundary is skipped
+    typedef HE_face *Type;
+    static bool Keep(const HE_edge *e) { return e->pair && e->pair->face; }
+    static Type Get(HE_edge *e) { return e->pair->face; }
+};
+
+// Forward iterator over Proj::Get(e) for the walked half-edges e that Proj::Keep.
+template <typename Proj>
+class ElementCirculator {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename Proj::Type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type *pointer;
+    typedef value_type reference;
+
+    ElementCirculator() : m_it() {}
+    explicit ElementCirculator(HalfEdgeCirculator it) : m_it(it) { SkipRejected(); }
+
+    value_type operator*() const { return Proj::Get(*m_it); }
+    ElementCirculator &operator++() {
+        ++m_it;
+        SkipRejected();
+        return *this;
+    }
+    ElementCirculator operator++(int) {
+        ElementCirculator old = *this;
+        ++(*this);
+        return old;
+    }
+    bool operator==(const ElementCirculator &other) const { return m_it == other.m_it; }
+    bool operator!=(const ElementCirculator &other) const { return m_it != other.m_it; }
+
+private:
+    void SkipRejected() {
+        while (*m_it && !Proj::Keep(*m_it)) ++m_it;
+    }
+
+    HalfEdgeCirculator m_it;
+};
+
+// A neighborhood for range-for, e.g.  for (HE_vert *u : mesh.VertexVertices(v)) ...
+template <typename Proj>
+class ElementRange {
+public:
+    typedef ElementCirculator<Proj> iterator;
+
+    explicit ElementRange(HalfEdgeCirculator begin) : m_begin(begin) {}
+    iterator begin() const { return iterator(m_begin); }
+    iterator end() const { return iterator(); }
+    bool empty() const { return begin() == end(); }
+    std::size_t size() const { return std::size_t(std::distance(begin(), end())); }
+
+private:
+    HalfEdgeCirculator m_begin;
+};
+
+enum class BuildMode {
+	Strict,		// the input must be a clean manifold, violations are asserted
+	Tolerant	// repair the input so that the half-edge invariants hold, see BuildReport
+};
+
+// What a tolerant construction found and repaired.  Element ids are the ones of the input.
+struct BuildReport {
+	std::vector<int> invalid_faces;		// faces with a missing or repeated vertex, left out of the mesh
+	std::vector<std::pair<int, int>> nonmanifold_edges;	// vertex ids of edges shared by more than two faces;
+														// all but two of the faces are detached there
+	std::vector<std::pair<int, int>> conflicting_edges;	// edges whose faces cannot be oriented consistently,
+														// cut open into two boundary edges
+	std::vector<int> nonmanifold_vertices;	// vertices whose faces form several fans...
+	std::vector<int> split_vertices;		// ...and the copies added for all fans but the first
+	int num_isolated_vertices;				// vertices without any face, kept as they are
+
+	BuildReport() : num_isolated_vertices(0) {}
+
+	bool IsClean() const {
+		return invalid_faces.empty() && nonmanifold_edges.empty() && conflicting_edges.empty() &&
+			nonmanifold_vertices.empty();
+	}
+
+	void Print() const {
+		printf("BuildReport: %d invalid faces, %d non-manifold edges, %d conflicting edges, "
+			   "%d non-manifold vertices (%d copies added), %d isolated vertices.\n",
+			   (int)invalid_faces.size(), (int)nonmanifold_edges.size(), (int)conflicting_edges.size(),
+			   (int)nonmanifold_vertices.size(), (int)split_vertices.size(), num_isolated_vertices);
+	}
+};
+
 class TriMesh {
 
 protected:
 
 // AdjacencyInfo contains necessary adjacency information for constructing TriMesh class.
 // Upon construction of TriMesh the AdjacencyInfo is no longer needed.
+// Everything is stored in flat arrays indexed by corners, see MeshTopology.h: fvert holds the
+// vertex indices (into m_vertices) of the corners, and cpair the opposite corner across an edge.
+// Connected components share no vertex, thus pairing and orienting run on them in parallel.
 struct AdjacencyInfo {
-	std::map<HE_face*, std::array<HE_vert*, 3>> fvert;
-	std::map<HE_vert*, std::forward_list<HE_face*>> vface;
-	std::map<HE_face*, std::set<HE_face*>> fface;	// TODO: Try to replace std::set to other data structure to reduce complexity.
-	std::map<int, HE_edge*> edgemap;
-	std::map<int, HE_face*> facemap;
-	std::map<int, HE_vert*> vertmap;
+	std::vector<int> fvert;		// consistently oriented after UpdateAdjacencyInfo
+	std::vector<int> cpair;		// -1 on the boundary
+	std::vector<int> comp_faces;		// faces of component i at comp_face_offsets[i] .. [i+1]
+	std::vector<int> comp_face_offsets;
+	std::vector<int> comp_verts;		// same for vertices, unused vertices are left out
+	std::vector<int> comp_vert_offsets;
 	TriMesh *mesh;	// Since AdjacencyInfo is owned by TriMesh, no need to free.
+	BuildMode mode;	// in tolerant mode the findings go to mesh->m_build_report
 	bool isUpdated;
 
 	// constructor
 	AdjacencyInfo(TriMesh *m)
-		: fvert{}, vface{}, edgemap{}, facemap{}, vertmap{}, mesh{m}, isUpdated{false}
+		: fvert{}, cpair{}, comp_faces{}, comp_face_offsets{}, comp_verts{}, comp_vert_offsets{},
+		mesh{m}, mode{BuildMode::Strict}, isUpdated{false}
 	{}
 
-	// Do all the work together.
-	void UpdateAdjacencyInfo() {
-		CreateEdgeMap();
-		CreateFaceMap();
-		CreateVertexMap();
+	// Do all the work together.  `progress` is called between the stages and may return false to stop,
+	// in which case false is returned and the info is left not updated.
+	bool UpdateAdjacencyInfo(const ProgressCallback &progress = ProgressCallback()) {
+		auto keep_going = [&](float fraction) { return !progress || progress(fraction); };
 		ConstructFaceVertices();
-		ConstructVertexFaces();
-		ConstructFaceFaces();
+		if (mode == BuildMode::Tolerant)
+			RemoveInvalidFaces();
+		if (!keep_going(0.2f)) return false;
+		ConstructComponents();
+		if (!keep_going(0.4f)) return false;
+		ConstructEdgePairs();
+		if (!keep_going(0.7f)) return false;
+		OrientFaces();
+		if (mode == BuildMode::Tolerant) {
+			if (!keep_going(0.8f)) return false;
+			CutConflictingEdges();
+			if (!keep_going(0.85f)) return false;
+			if (SplitNonManifoldVertices() > 0)
+				ConstructComponents();
+			mesh->m_build_report.num_isolated_vertices = int(mesh->m_vertices.size() - comp_verts.size());
+		}
 		isUpdated = true;
+		return keep_going(1.f);
 	}
 
-	// return a `reversed` map that maps edges/vertices/faces/ id into their corresponding pointer
-	const std::map<int, HE_edge*> &CreateEdgeMap() {
-		assert(mesh != nullptr && "AdjacencyInfo.CreateEdgeMap: mesh not initialized.");
-		edgemap.clear();
-		for (const auto edge_ptr : mesh->m_edges) {
-			edgemap[edge_ptr->id] = edge_ptr;
-		}
-		return edgemap;
+	void Clear() {
+		std::vector<int>().swap(fvert);
+		std::vector<int>().swap(cpair);
+		std::vector<int>().swap(comp_faces);
+		std::vector<int>().swap(comp_face_offsets);
+		std::vector<int>().swap(comp_verts);
+		std::vector<int>().swap(comp_vert_offsets);
+		isUpdated = false;
 	}
 
-	const std::map<int, HE_face*> &CreateFaceMap() {
-		assert(mesh != nullptr && "AdjacencyInfo.CreateFaceMap: mesh not initialized.");
-		facemap.clear();
-		for (const auto face_ptr : mesh->m_faces) {
-			facemap[face_ptr->id] = face_ptr;
-		}
-		return facemap;
+	int NumComponents() const {
+		return comp_face_offsets.empty() ? 0 : int(comp_face_offsets.size()) - 1;
 	}
 
-	const std::map<int, HE_vert*> &CreateVertexMap() {
-		assert(mesh != nullptr && "AdjacencyInfo.CreateVertexMap: mesh not initialized.");
-		vertmap.clear();
-		for (const auto vert_ptr : mesh->m_vertices) {
-			vertmap[vert_ptr->id] = vert_ptr;
-		}
-		return vertmap;
+	// Worker threads for the construction, only large meshes are split.
+	int NumBuildThreads() const {
+		return MIN<int>(NumThreads(), int(mesh->m_faces.size() / 16384) + 1);
 	}
 
-	const std::map<HE_face*, std::array<HE_vert*, 3>> &ConstructFaceVertices () {
+	// Translate the vertex ids of every face into indices of m_vertices.
+	// Complexity O(V+F), or O(Flog(V)) for sparse ids.
+	const std::vector<int> &ConstructFaceVertices() {
 		assert(mesh != nullptr && "AdjacencyInfo.ConstructFaceVertices: mesh not initialized.");
-		assert(!vertmap.empty() && "AdjacencyInfo.ConstructFaceVertices: vertmap not initialized.");
-		fvert.clear();
-		for (const auto face_ptr : mesh->m_faces) {
-			std::array<HE_vert*, 3> fv{ nullptr, nullptr, nullptr };
-			int counter_debug = 0;
-			for (int i = 0; i < 3; ++i) {
-				auto vertiter = vertmap.find(face_ptr->vertid[i]);
-				if (vertiter != vertmap.end()) {
-					fv[i] = vertiter->second;
-					counter_debug++;
-				} else {
-					printf("AdjacencyInfo.ConstructFaceVertices: Cannot find vertex of id %d.\n", face_ptr->vertid[i]);
-					continue;
+		const auto &verts = mesh->m_vertices;
+		const auto &faces = mesh->m_faces;
+		VertexIdMap idmap(verts.size(), [&](std::size_t i) { return verts[i]->id; });
+		fvert.assign(3 * faces.size(), -1);
+		ParallelFor(0, faces.size(), [&](std::size_t b, std::size_t e, int) {
+			for (std::size_t f = b; f < e; ++f) {
+				for (int k = 0; k < 3; ++k) {
+					int idx = idmap.Lookup(faces[f]->vertid[k]);
+					if (idx < 0)
+						printf("AdjacencyInfo.ConstructFaceVertices: Cannot find vertex of id %d.\n", faces[f]->vertid[k]);
+					assert((idx >= 0 || mode == BuildMode::Tolerant) &&
+						"AdjacencyInfo.CounstructFaceVertices: Cannot find all vertice for face");
+					fvert[3*f + k] = idx;
 				}
 			}
-			assert(counter_debug == 3 && "AdjacencyInfo.CounstructFaceVertices: Cannot find all vertice for face");
-			fvert[face_ptr] = fv;
-		}
+		}, NumBuildThreads());
 		return fvert;
 	}
 
-	const std::map<HE_vert*, std::forward_list<HE_face*>> &ConstructVertexFaces() {
-		assert(!fvert.empty() && "AdjacencyInfo.ConstructVertexFaces: fvert not initialized.");
-		vface.clear();
-		for (const auto fv_iter : fvert) {
-			for (const auto vert_ptr : fv_iter.second) {
-				vface[vert_ptr].push_front(fv_iter.first);
+	// Leave out the faces with a missing or repeated vertex, which cannot be made of half-edges.
+	// Complexity O(F).
+	void RemoveInvalidFaces() {
+		auto &faces = mesh->m_faces;
+		std::size_t kept = 0;
+		for (std::size_t f = 0; f < faces.size(); ++f) {
+			const int a = fvert[3*f], b = fvert[3*f + 1], c = fvert[3*f + 2];
+			if (a < 0 || b < 0 || c < 0 || a == b || b == c || c == a) {
+				mesh->m_build_report.invalid_faces.push_back(faces[f]->id);
+				continue;
 			}
+			faces[kept] = faces[f];
+			fvert[3*kept] = a;
+			fvert[3*kept + 1] = b;
+			fvert[3*kept + 2] = c;
+			++kept;
 		}
-		return vface;
-	}
-
-	// Create a map that maps a face to its adjacent faces.
-	// Complexity O(V)
-	const std::map<HE_face*, std::set<HE_face*>> &ConstructFaceFaces() {
-		assert(!vface.empty() && "AdjacencyInfo.ConstructFaceFaces: vface not initialized.");
-		fface.clear();
-		for (const auto vf_iter : vface) {
-			const auto &vflist = vf_iter.second;	// a forward_list of all faces around a vertex
-			for (const auto f1 : vflist) {
-				for (const auto f2 : vflist) {
-					if (f1->id == f2->id) continue;
-					if (IsFaceAdjacent(f1, f2)) {	// add f2 into f1 forward_list
-						auto fiter = fface.find(f1);
-						if (fiter == fface.end()) {	// if there is no key `f1` inside the map
-							fface[f1] = std::set<HE_face*>{ f2 };
-						} else {
-							fface[f1].insert(f2);
-						}
-					}
-				}
+		faces.resize(kept);
+		fvert.resize(3 * kept);
+	}
+
+	// Find the connected components (faces sharing a vertex) with union-find, and group the faces
+	// and the vertices by component.  Complexity O(V+F).
+	void ConstructComponents() {
+		assert(fvert.size() == 3 * mesh->m_faces.size() && "AdjacencyInfo.ConstructComponents: fvert not initialized.");
+		std::vector<int> face_comp, vert_comp;
+		int num_comps = LabelComponents(fvert, int(mesh->m_vertices.size()), face_comp, vert_comp);
+		GroupByLabel(face_comp, num_comps, comp_faces, comp_face_offsets);
+		GroupByLabel(vert_comp, num_comps, comp_verts, comp_vert_offsets);
+	}
+
+	// Pair up the corners sharing an edge, one component per task.  Complexity O(F).
+	const std::vector<int> &ConstructEdgePairs() {
+		assert(fvert.size() == 3 * mesh->m_faces.size() && "AdjacencyInfo.ConstructEdgePairs: fvert not initialized.");
+		assert(comp_vert_offsets.size() == comp_face_offsets.size() && "AdjacencyInfo.ConstructEdgePairs: components not found.");
+		cpair.assign(fvert.size(), -1);
+		std::vector<int> offsets, bucket;
+		BucketCorners(fvert, int(mesh->m_vertices.size()), offsets, bucket);
+		const int threads = NumBuildThreads();
+		std::vector<std::vector<int>> nonmanifold(threads);	// first corner of each such edge
+		ParallelFor(0, NumComponents(), [&](std::size_t b, std::size_t e, int t) {
+			for (int i = comp_vert_offsets[b]; i < comp_vert_offsets[e]; ++i) {
+				const int v = comp_verts[i];
+				PairBucket(fvert, bucket.data() + offsets[v], bucket.data() + offsets[v + 1], cpair, &nonmanifold[t]);
 			}
+		}, threads);
+		std::vector<int> corners;
+		for (const auto &list : nonmanifold) corners.insert(corners.end(), list.begin(), list.end());
+		std::sort(corners.begin(), corners.end());
+		if (!corners.empty())
+			printf("AdjacencyInfo.ConstructEdgePairs: %d edges are shared by more than two faces.\n", (int)corners.size());
+		assert((corners.empty() || mode == BuildMode::Tolerant) && "AdjacencyInfo.ConstructEdgePairs: Non-manifold case occur!");
+		for (int c : corners)
+			mesh->m_build_report.nonmanifold_edges.push_back(EdgeIds(c));
+		return cpair;
+	}
+
+	// Orient all faces consistently, one component per task.  The vertex ids of flipped faces are
+	// swapped accordingly.  Complexity O(F).
+	void OrientFaces() {
+		const int num_faces = int(mesh->m_faces.size());
+		std::vector<char> visited(num_faces, 0), flipped(num_faces, 0);
+		const int threads = NumBuildThreads();
+		std::vector<int> counts(threads, 0);
+		ParallelFor(0, NumComponents(), [&](std::size_t b, std::size_t e, int t) {
+			counts[t] += OrientCornersOf(comp_faces.data() + comp_face_offsets[b], comp_face_offsets[e] - comp_face_offsets[b],
+										 fvert, cpair, visited, &flipped);
+		}, threads);
+		int num_conflicts = 0;
+		for (int n : counts) num_conflicts += n;
+		if (num_conflicts > 0)
+			printf("AdjacencyInfo.OrientFaces: The mesh is not orientable (%d conflicting edges).\n", num_conflicts);
+		for (std::size_t f = 0; f < flipped.size(); ++f) {
+			if (flipped[f]) std::swap(mesh->m_faces[f]->vertid[1], mesh->m_faces[f]->vertid[2]);
 		}
-		assert(std::all_of(fface.begin(), fface.end(), [](const std::pair<HE_face*, std::set<HE_face*>> &p) {return p.second.size() <= 3;}) &&
-			"AdjacencyInfo.ConstructFaceFaces: Some faces contains more than 3 adjacent faces.");
-		return fface;
-	}
-
-	// Determine whether two faces are adjacent.
-	// Conplexity O(1).
-	static bool IsFaceAdjacent(HE_face *f1, HE_face *f2) {
-		int count = 0;
-		for (auto vid : f1->vertid) {
-			if (vid == f2->vertid[0] || vid == f2->vertid[1] || vid == f2->vertid[2])
-				count++;
+	}
+
+	// Unpair the edges whose two faces still traverse them the same way after OrientFaces, so that
+	// the two half-edges of every pair are oppositely oriented.  Complexity O(F).
+	void CutConflictingEdges() {
+		const int threads = NumBuildThreads();
+		std::vector<std::vector<int>> cut(threads);
+		ParallelFor(0, NumComponents(), [&](std::size_t b, std::size_t e, int t) {
+			for (int i = comp_face_offsets[b]; i < comp_face_offsets[e]; ++i) {
+				for (int c = 3 * comp_faces[i]; c < 3 * comp_faces[i] + 3; ++c) {
+					const int d = cpair[c];
+					if (d < 0 || fvert[d] != fvert[c]) continue;
+					cpair[c] = cpair[d] = -1;
+					cut[t].push_back(c);
+				}
+			}
+		}, threads);
+		std::vector<int> corners;
+		for (const auto &list : cut) corners.insert(corners.end(), list.begin(), list.end());
+		std::sort(corners.begin(), corners.end());
+		for (int c : corners)
+			mesh->m_build_report.conflicting_edges.push_back(EdgeIds(c));
+	}
+
+	// Give every fan of a vertex but the first its own copy of the vertex (same position, new id), so
+	// that the faces around every vertex can be walked from a single half-edge.  Detection runs over the
+	// vertices in parallel and skips those whose corners close a single cycle; the splits are applied
+	// afterwards.  Run after orienting and cutting, when paired corners are oppositely oriented.
+	// Return the number of copies.
+	int SplitNonManifoldVertices() {
+		const int num_verts = int(mesh->m_vertices.size());
+		std::vector<int> vcorners, voffsets, slot;	// corners leaving each vertex, and their positions there
+		GroupByLabel(fvert, num_verts, vcorners, voffsets);
+		const int threads = NumBuildThreads();
+		CornerSlots(vcorners, voffsets, slot);
+		std::vector<std::vector<int>> found(threads);
+		ParallelFor(0, num_verts, [&](std::size_t b, std::size_t e, int t) {
+			std::vector<int> fan;
+			for (std::size_t v = b; v < e; ++v) {
+				const int *first = vcorners.data() + voffsets[v], *last = vcorners.data() + voffsets[v + 1];
+				if (first == last || IsSingleCycle(first, last, cpair, slot)) continue;
+				if (LabelFans(first, last, cpair, slot, fan) > 1) found[t].push_back(int(v));
+			}
+		}, threads);
+		std::vector<int> verts;
+		for (const auto &list : found) verts.insert(verts.end(), list.begin(), list.end());
+		if (verts.empty()) return 0;
+		std::sort(verts.begin(), verts.end());
+		int next_id = 0;
+		for (auto v : mesh->m_vertices) next_id = std::max(next_id, v->id + 1);
+		BuildReport &report = mesh->m_build_report;
+		std::vector<int> fan;
+		for (int v : verts) {
+			const int *first = vcorners.data() + voffsets[v];
+			const int num_fans = LabelFans(first, vcorners.data() + voffsets[v + 1], cpair, slot, fan);
+			const HE_vert orig = *mesh->m_vertices[v];
+			report.nonmanifold_vertices.push_back(orig.id);
+			for (int k = 1; k < num_fans; ++k) {
+				HE_vert *copy = mesh->InsertVertex(orig.x, orig.y, orig.z, next_id++);
+				report.split_vertices.push_back(copy->id);
+				for (std::size_t i = 0; i < fan.size(); ++i) {
+					if (fan[i] != k) continue;
+					fvert[first[i]] = copy->index;
+					mesh->m_faces[first[i] / 3]->vertid[first[i] % 3] = copy->id;
+				}
+			}
 		}
-		return count == 2;
+		printf("AdjacencyInfo.SplitNonManifoldVertices: Split %d non-manifold vertices into %d more.\n",
+			   (int)report.nonmanifold_vertices.size(), (int)report.split_vertices.size());
+		return int(report.split_vertices.size());
+	}
+
+	// Vertex ids of the edge of corner c.
+	std::pair<int, int> EdgeIds(int c) const {
+		return std::make_pair(mesh->m_vertices[fvert[c]]->id, mesh->m_vertices[fvert[CornerNext(c)]]->id);
 	}
 
 };
 
+// Flat arrays kept between normal computations, so that an edit can be refreshed locally:
+// positions as of the last MarkDirty or ComputeNormal, normals and corner weights (see MeshNormals.h).
+struct NormalCache {
+	std::vector<float> px, py, pz;
+	std::vector<float> vnx, vny, vnz;
+	std::vector<float> fnx, fny, fnz;
+	std::vector<float> cw;
+	NormalWeighting weighting;
+
+	NormalCache() : weighting(NormalWeighting::Uniform) {}
+
+	void Resize(std::size_t num_verts, std::size_t num_faces) {
+		px.resize(num_verts); py.resize(num_verts); pz.resize(num_verts);
+		vnx.resize(num_verts); vny.resize(num_verts); vnz.resize(num_verts);
+		fnx.resize(num_faces); fny.resize(num_faces); fnz.resize(num_faces);
+		cw.resize(3 * num_faces);
+	}
+	bool Matches(std::size_t num_verts, std::size_t num_faces) const {
+		return px.size() == num_verts && fnx.size() == num_faces;
+	}
+};
+
+// Vertices moved since the last normal update, and scratch marks used by Refresh.
+struct DirtyState {
+	std::vector<int> verts;
+	std::vector<char> flag;			// per vertex, set for the ones in `verts`
+	std::vector<char> vert_mark;	// all zeros between calls
+	std::vector<char> face_mark;
+};
+
 
 public:
 	TriMesh()
 			: m_edges(), m_vertices(), m_faces(),
+			m_out_offsets(), m_out_edges(), m_triangles(), m_corner_offsets(), m_corners(),
+			m_component_faces(), m_component_offsets(), m_next_edge_id(0), m_build_report(),
+			m_normal_cache(), m_dirty(), m_bbox_min{0.f, 0.f, 0.f}, m_bbox_max{0.f, 0.f, 0.f}, m_bbox_valid(false),
+			m_revision(0),
+			m_edge_pool(), m_vert_pool(), m_face_pool(),
 			m_adjacency_info(std::unique_ptr<AdjacencyInfo>(new AdjacencyInfo(this)))
 	{}
 
@@ -246,13 +554,15 @@ public:
 	}
 
 	// Insert method.  Note that insertion does not involve any torpology modification.
+	// Elements are allocated from the pools of the mesh and live as long as the mesh.
 	HE_vert *InsertVertex(float x, float y, float z, int id) {
 		try {
-			HE_vert *vert = new HE_vert();
+			HE_vert *vert = m_vert_pool.New();
 			vert->x = x;
 			vert->y = y;
 			vert->z = z;
 			vert->id = id;
+			vert->index = int(m_vertices.size());
 			m_vertices.push_back(vert);
 			return vert;
 		} catch (const std::exception &e) {
@@ -263,7 +573,7 @@ public:
 
 	HE_face *InsertFace(int id, int vertid1, int vertid2, int vertid3) {
 		try {
-			HE_face *face = new HE_face();
+			HE_face *face = m_face_pool.New();
 			face->id = id;
 			face->vertid[0] = vertid1;
 			face->vertid[1] = vertid2;
@@ -276,11 +586,13 @@ public:
 		}
 	}
 
+	// Ids handed out afterwards start past `id`.
 	HE_edge* InsertEdge(int id) {
 		try {
-			HE_edge *edge = new HE_edge();
+			HE_edge *edge = m_edge_pool.New();
 			edge->id = id;
 			m_edges.push_back(edge);
+			if (id >= m_next_edge_id) m_next_edge_id = id + 1;
 			return edge;
 		} catch (const std::exception &e) {
 			printf("TriMesh.InsertEdge: %s\n", e.what());
@@ -288,304 +600,525 @@ public:
 		}
 	}
 
+	// Reserve storage once the element counts are known, e.g. after parsing.
+	// A closed triangle mesh has 3F half-edges, plus one more per boundary edge.  The half-edges are
+	// reserved exactly by AddEdgesGlobal, so `num_edges` is only needed when inserting them directly.
+	void Reserve(std::size_t num_vertices, std::size_t num_faces, std::size_t num_edges = 0) {
+		m_vertices.reserve(num_vertices);
+		m_faces.reserve(num_faces);
+		m_vert_pool.Reserve(num_vertices);
+		m_face_pool.Reserve(num_faces);
+		if (num_edges > 0) {
+			m_edges.reserve(num_edges);
+			m_edge_pool.Reserve(num_edges);
+		}
+	}
+
 
 	// The algorithm of creating edges are as follows:
-	// - For the initial face, six half-edges are added.
-	// - Then in a BFS manner, adjacent faces are traversed and edges are added.
-	// https://en.wikipedia.org/wiki/Breadth-first_search
+	// - AdjacencyInfo pairs up the corners of all faces and orients the faces consistently.
+	// - Three half-edges are created for each face, in the order of m_faces, and linked around the face.
+	// - Paired corners become pairs of half-edges; an unpaired corner gets a boundary half-edge
+	//   (without face, next and prev) as its pair.  Boundary half-edges are stored after all the others.
 	// This process guarantees the orientations for manifold mesh.
 	// Note that it is not robust to non-manifold case.  The user is responsible to check that the underlining
 	// mesh torpology does not have any non-manifold-ness.
 	// This involves connecting more than two faces to a single edges, or cannot traverse all adjacent 
 	// faces for a vertex by half-edge data structure (namely the vertex only points to ONE adjacent half-edge).
-	// The complexity is O(Flog(F) + FE) (or O(Flog(F) + Flog(E)) with different add edge method).
-	// Udpate: The complexity is O(Flog(F)).
+	// The complexity is O(F).
 	void AddEdgesGlobal() {
 		if (m_faces.empty()) {
 			printf("TriMesh.CreateEdgesGlobal: Cannot find any faces. Nothing is done.\n");
 			return;
 		}
+		if (!m_edges.empty()) {
+			printf("TriMesh.AddEdgesGlobal: The edges are already inserted.\n");
+			return;
+		}
 		if (!m_adjacency_info->isUpdated) {
 			m_adjacency_info->UpdateAdjacencyInfo();
 		}
-		std::queue<HE_face*> faces_queue{};
-		faces_queue.push(m_faces.front());
-		std::set<HE_face*> faces_set(m_faces.begin() + 1, m_faces.end());
-		while(!faces_queue.empty()) {
-			assert(!faces_queue.empty() && "TriMesh.AddEdgesGlobal: The mesh is not connected.");
-			HE_face *f = faces_queue.front();
-			faces_queue.pop();
-			AddFaceEdgesGlobal(f);
-			auto fface_iter = m_adjacency_info->fface.find(f);
-			assert(fface_iter != m_adjacency_info->fface.end() &&
-				"TriMesh.AddEdgesGlobal: Cannot find the face from face-face adjacent map");
-			for (const auto fadj : fface_iter->second) {	// adjacent faces
-				auto fset_it = faces_set.find(fadj);
-				if (fset_it != faces_set.end()) {
-					faces_set.erase(fset_it);
-					faces_queue.push(fadj);
+		const AdjacencyInfo &info = *m_adjacency_info;
+		const std::vector<int> &fvert = info.fvert;
+		const std::vector<int> &cpair = info.cpair;
+		const int num_corners = int(fvert.size());
+		// the boundary half-edge of corner c is stored at num_corners + boundary_rank[c]
+		std::vector<int> boundary_rank(num_corners, -1);
+		int num_boundary = 0;
+		for (int c = 0; c < num_corners; ++c)
+			if (cpair[c] < 0) boundary_rank[c] = num_boundary++;
+		m_edges.reserve(num_corners + num_boundary);
+		m_edge_pool.Reserve(num_corners + num_boundary);
+		const int first_id = NewEdgeIds(num_corners + num_boundary);	// one block of ids for all of them
+		for (int i = 0; i < num_corners + num_boundary; ++i) {
+			InsertEdge(first_id + i);
+		}
+		// Components share no vertex, so each is linked by one task without any locking.
+		ParallelFor(0, info.NumComponents(), [&](std::size_t comp_begin, std::size_t comp_end, int) {
+			const int *first = info.comp_faces.data() + info.comp_face_offsets[comp_begin];
+			const int *last = info.comp_faces.data() + info.comp_face_offsets[comp_end];
+			// always v0->e0->v1->e1->v2->e2->v0
+			for (const int *f = first; f != last; ++f) {
+				for (int c = 3 * *f; c < 3 * *f + 3; ++c) {
+					HE_edge *e = m_edges[c];
+					HE_face *face = m_faces[c / 3];
+					e->vert = m_vertices[fvert[CornerNext(c)]];
+					e->face = face;
+					e->next = m_edges[CornerNext(c)];
+					e->prev = m_edges[CornerPrev(c)];
+					if (cpair[c] >= 0) e->pair = m_edges[cpair[c]];
+					if (c % 3 == 0) face->edge = e;
+					HE_vert *v = m_vertices[fvert[c]];
+					if (v->edge == nullptr) v->edge = e;
+				}
+			}
+			for (const int *f = first; f != last; ++f) {
+				for (int c = 3 * *f; c < 3 * *f + 3; ++c) {
+					if (cpair[c] >= 0) continue;
+					HE_edge *e = m_edges[c];
+					HE_edge *b = m_edges[num_corners + boundary_rank[c]];
+					HE_vert *v = m_vertices[fvert[c]];
+					b->vert = v;
+					b->pair = e;
+					e->pair = b;
+					// A boundary vertex points to the out edge whose pair is on boundary,
+					// where the traversal of its out edges starts.
+					v->edge = e;
 				}
 			}
+		}, info.NumBuildThreads());
+		m_component_faces = info.comp_faces;
+		m_component_offsets = info.comp_face_offsets;
+		BuildOutEdgeTable();
+		BuildCornerTable();
+	}
+
+	// Build the flat tables below from the linked half-edges.  Call it again whenever they change.
+	void BuildTables() {
+		BuildOutEdgeTable();
+		BuildCornerTable();
+		BuildComponentTable();
+	}
+
+	// Connected components, two faces being connected if they share a vertex (see LabelComponents).
+	// Requires the corner table.  AddEdgesGlobal takes them from the construction instead.
+	void BuildComponentTable() {
+		std::vector<int> face_comp, vert_comp;
+		int num_comps = LabelComponents(m_triangles, int(m_vertices.size()), face_comp, vert_comp);
+		GroupByLabel(face_comp, num_comps, m_component_faces, m_component_offsets);
+	}
+
+	std::size_t NumComponents() const {
+		return m_component_offsets.empty() ? 0 : m_component_offsets.size() - 1;
+	}
+
+	// Positions in the face list (see GetFace) of the faces of component `i`, in increasing order.
+	// Components are numbered in the order of their first face.
+	std::pair<const int *, const int *> GetComponentFaces(std::size_t i) const {
+		assert(i < NumComponents() && "TriMesh.GetComponentFaces: Component out of range.");
+		return std::make_pair(m_component_faces.data() + m_component_offsets[i],
+							  m_component_faces.data() + m_component_offsets[i + 1]);
+	}
 
+	// Collect the out edges of every vertex into one table in compressed sparse row layout:
+	// the out edges of vertex v are m_out_edges[m_out_offsets[v->index] .. m_out_offsets[v->index+1]).
+	// Called once all half-edges are linked.  Complexity O(V+E).
+	void BuildOutEdgeTable() {
+		const std::size_t num_verts = m_vertices.size();
+		m_out_offsets.assign(num_verts + 1, 0);
+		for (auto e : m_edges) {
+			if (e->pair && e->pair->vert) m_out_offsets[e->pair->vert->index + 1]++;
 		}
+		for (std::size_t v = 0; v < num_verts; ++v) m_out_offsets[v + 1] += m_out_offsets[v];
+		m_out_edges.assign(m_out_offsets[num_verts], nullptr);
+		std::vector<int> fill(m_out_offsets.begin(), m_out_offsets.end() - 1);
+		for (auto e : m_edges) {
+			if (e->pair && e->pair->vert) m_out_edges[fill[e->pair->vert->index]++] = e;
+		}
+	}
+
+	// Flat copy of the face vertices: m_triangles holds the vertex indices of face f, starting from
+	// the vertex its `edge` leaves, at 3f..3f+2 (corners, see MeshTopology.h), and the corners of
+	// vertex v are m_corners[m_corner_offsets[v->index] .. m_corner_offsets[v->index+1]).
+	// They feed the normal kernels.  Complexity O(V+F).
+	void BuildCornerTable() {
+		const std::size_t num_verts = m_vertices.size(), num_faces = m_faces.size();
+		m_triangles.assign(3 * num_faces, -1);
+		m_corner_offsets.assign(num_verts + 1, 0);
+		for (std::size_t f = 0; f < num_faces; ++f) {
+			HE_edge *e = m_faces[f]->edge;
+			assert(e && e->pair && e->next && "TriMesh.BuildCornerTable: Face edges are not linked.");
+			m_triangles[3*f] = e->pair->vert->index;
+			m_triangles[3*f + 1] = e->vert->index;
+			m_triangles[3*f + 2] = e->next->vert->index;
+			for (int k = 0; k < 3; ++k) m_corner_offsets[m_triangles[3*f + k] + 1]++;
+		}
+		for (std::size_t v = 0; v < num_verts; ++v) m_corner_offsets[v + 1] += m_corner_offsets[v];
+		m_corners.assign(m_corner_offsets[num_verts], -1);
+		std::vector<int> fill(m_corner_offsets.begin(), m_corner_offsets.end() - 1);
+		for (std::size_t c = 0; c < m_triangles.size(); ++c) m_corners[fill[m_triangles[c]]++] = int(c);
+	}
+
+	// Vertex indices of face f at 3f..3f+2, see BuildCornerTable.  Ready to be used as an index buffer.
+	const std::vector<int> &GetTriangles() const {
+		return m_triangles;
 	}
 
-    void ComputeNormal() {
-        for (auto f : m_faces) f->ComputeNormal();
-        for (auto v : m_vertices) v->ComputeNormal();
+	// Incremented whenever normals are recomputed, which every change of the positions or of the
+	// topology goes through.  Copies of the mesh (e.g. on the GPU) compare it to know when they are stale.
+	std::size_t Revision() const {
+		return m_revision;
+	}
+
+	// The out edges of `v` in no particular order, as a range of the out edge table.
+	std::pair<HE_edge *const *, HE_edge *const *> GetOutEdgeTable(const HE_vert *v) const {
+		assert(v && v->index >= 0 && std::size_t(v->index) + 1 < m_out_offsets.size() &&
+			"TriMesh.GetOutEdgeTable: Out edge table is not built.");
+		return std::make_pair(m_out_edges.data() + m_out_offsets[v->index],
+							  m_out_edges.data() + m_out_offsets[v->index + 1]);
+	}
+
+    // Recompute all face and vertex normals from scratch with the kernels of MeshNormals.h.
+    // Positions are gathered into flat arrays, faces are processed in SIMD batches and both passes are
+    // split over `num_threads` threads (see NumThreads).  Complexity O(V+F).
+    void ComputeNormal(NormalWeighting weighting = NormalWeighting::Uniform, int num_threads = 0) {
+        const int num_verts = int(m_vertices.size()), num_faces = int(m_faces.size());
+        if (m_triangles.size() != 3 * m_faces.size() || m_corner_offsets.size() != m_vertices.size() + 1) {
+            printf("TriMesh.ComputeNormal: Edges are not built. Nothing is done.\n");
+            return;
+        }
+        NormalCache &nc = m_normal_cache;
+        nc.Resize(num_verts, num_faces);
+        nc.weighting = weighting;
+        // threads only pay off for large meshes
+        const int threads = MIN<int>(NumThreads(num_threads), (num_verts + num_faces) / 65536 + 1);
+        ParallelFor(0, num_verts, [&](std::size_t b, std::size_t e, int) {
+            for (std::size_t i = b; i < e; ++i) {
+                nc.px[i] = m_vertices[i]->x;
+                nc.py[i] = m_vertices[i]->y;
+                nc.pz[i] = m_vertices[i]->z;
+            }
+        }, threads);
+        this->UpdateNormals(nullptr, num_faces, nullptr, num_verts, threads);
+        this->ClearDirty();
+        m_bbox_valid = false;   // positions may have been changed without MarkDirty
+    }
+
+    // Move vertex `v` and record the change, see MarkDirty.
+    void SetVertexPosition(HE_vert *v, float x, float y, float z) {
+        assert(v && "TriMesh.SetVertexPosition: Input nullptr.");
+        v->x = x;
+        v->y = y;
+        v->z = z;
+        this->MarkDirty(v);
+    }
+
+    // Record that the position of `v` has changed, e.g. after assigning v->x directly.
+    // The bounding box grows with the new position right away.  It is only swept again if the old
+    // position was on its boundary and moved inwards.  Normals wait for Refresh().
+    void MarkDirty(HE_vert *v) {
+        assert(v && v->index >= 0 && std::size_t(v->index) < m_vertices.size() &&
+            "TriMesh.MarkDirty: Vertex does not belong to the mesh.");
+        const int i = v->index;
+        if (m_dirty.flag.size() != m_vertices.size()) m_dirty.flag.assign(m_vertices.size(), 0);
+        if (!m_dirty.flag[i]) {
+            m_dirty.flag[i] = 1;
+            m_dirty.verts.push_back(i);
+        }
+        NormalCache &nc = m_normal_cache;
+        if (!nc.Matches(m_vertices.size(), m_faces.size())) {
+            m_bbox_valid = false;   // the old position is unknown
+            return;
+        }
+        const float old_pos[3] = {nc.px[i], nc.py[i], nc.pz[i]};
+        const float pos[3] = {v->x, v->y, v->z};
+        nc.px[i] = v->x;
+        nc.py[i] = v->y;
+        nc.pz[i] = v->z;
+        if (!m_bbox_valid) return;
+        for (int k = 0; k < 3; ++k) {
+            if ((old_pos[k] == m_bbox_min[k] && pos[k] > m_bbox_min[k]) ||
+                (old_pos[k] == m_bbox_max[k] && pos[k] < m_bbox_max[k])) {
+                m_bbox_valid = false;
+                return;
+            }
+            m_bbox_min[k] = MIN(m_bbox_min[k], pos[k]);
+            m_bbox_max[k] = MAX(m_bbox_max[k], pos[k]);
+        }
+    }
+
+    // Findings of the last tolerant Update().  Empty for meshes read from the cache.
+    const BuildReport &GetBuildReport() const {
+        return m_build_report;
+    }
+
+    std::size_t NumDirtyVertices() const {
+        return m_dirty.verts.size();
+    }
+
+    // Bring the normals up to date after vertices were moved.  Only the faces around the dirty vertices,
+    // and the vertices of those faces, are recomputed, so the cost is proportional to the edit.
+    // Without normals computed before (e.g. a mesh read from cache) it falls back to ComputeNormal.
+    void Refresh(int num_threads = 0) {
+        if (m_dirty.verts.empty()) return;
+        NormalCache &nc = m_normal_cache;
+        if (!nc.Matches(m_vertices.size(), m_faces.size())) {
+            this->ComputeNormal(nc.weighting, num_threads);
+            return;
+        }
+        if (m_dirty.face_mark.size() != m_faces.size()) m_dirty.face_mark.assign(m_faces.size(), 0);
+        if (m_dirty.vert_mark.size() != m_vertices.size()) m_dirty.vert_mark.assign(m_vertices.size(), 0);
+        std::vector<int> faces, verts;
+        for (int v : m_dirty.verts) {
+            for (int i = m_corner_offsets[v]; i < m_corner_offsets[v + 1]; ++i) {
+                const int f = m_corners[i] / 3;
+                if (m_dirty.face_mark[f]) continue;
+                m_dirty.face_mark[f] = 1;
+                faces.push_back(f);
+            }
+        }
+        for (int f : faces) {
+            m_dirty.face_mark[f] = 0;
+            for (int k = 0; k < 3; ++k) {
+                const int v = m_triangles[3*f + k];
+                if (m_dirty.vert_mark[v]) continue;
+                m_dirty.vert_mark[v] = 1;
+                verts.push_back(v);
+            }
+        }
+        for (int v : verts) m_dirty.vert_mark[v] = 0;
+        const int threads = MIN<int>(NumThreads(num_threads), int(faces.size() + verts.size()) / 65536 + 1);
+        this->UpdateNormals(faces.data(), int(faces.size()), verts.data(), int(verts.size()), threads);
+        this->ClearDirty();
+    }
+
+    // Axis aligned bounding box of all vertices, swept again only when MarkDirty could not keep it exact.
+    // All zeros for an empty mesh.
+    void GetBoundingBox(float bmin[3], float bmax[3]) {
+        if (!m_bbox_valid) this->ComputeBoundingBox();
+        for (int k = 0; k < 3; ++k) {
+            bmin[k] = m_bbox_min[k];
+            bmax[k] = m_bbox_max[k];
+        }
+    }
+
+    void ComputeBoundingBox() {
+        for (int k = 0; k < 3; ++k) m_bbox_min[k] = m_bbox_max[k] = 0.f;
+        if (!m_vertices.empty()) {
+            const HE_vert *v0 = m_vertices.front();
+            m_bbox_min[0] = m_bbox_max[0] = v0->x;
+            m_bbox_min[1] = m_bbox_max[1] = v0->y;
+            m_bbox_min[2] = m_bbox_max[2] = v0->z;
+        }
+        for (auto v : m_vertices) {
+            m_bbox_min[0] = MIN(m_bbox_min[0], v->x);
+            m_bbox_max[0] = MAX(m_bbox_max[0], v->x);
+            m_bbox_min[1] = MIN(m_bbox_min[1], v->y);
+            m_bbox_max[1] = MAX(m_bbox_max[1], v->y);
+            m_bbox_min[2] = MIN(m_bbox_min[2], v->z);
+            m_bbox_max[2] = MAX(m_bbox_max[2], v->z);
+        }
+        m_bbox_valid = true;
     }
 
     // Call this function after adding all vertices and faces.
-    void Update() {
-        this->UpdateAdjacencyGlobal();
+    // In tolerant mode defective input is repaired instead of asserted, see GetBuildReport.
+    // `progress` gets the fraction of the build done, between its stages, and may return false to cancel.
+    // The build then stops and false is returned; the mesh is left incomplete and should be dropped.
+    bool Update(BuildMode mode = BuildMode::Strict, const ProgressCallback &progress = ProgressCallback()) {
+        m_build_report = BuildReport();
+        m_adjacency_info->mode = mode;
+        if (!this->UpdateAdjacencyGlobal(SubProgress(progress, 0.f, 0.35f))) {
+            m_adjacency_info->Clear();
+            return false;
+        }
         this->AddEdgesGlobal();
+        m_adjacency_info->Clear();	// no longer needed once the edges are built
+        if (progress && !progress(0.9f)) return false;
         this->ComputeNormal();
+        if (progress) progress(1.f);
+        return true;
+    }
+
+    // Check the half-edge invariants (see MeshIssue) in one sweep over the edges, vertices and faces,
+    // each split over `num_threads` threads, and report all offending elements.  Pointers are only
+    // followed after they are checked, so a corrupted mesh is reported instead of crashing.
+    // `progress` is called after each sweep and may return false to stop; the result is then marked canceled.
+    // Complexity O(V+E+F).
+    ValidationResult Validate(int num_threads = 0, const ProgressCallback &progress = ProgressCallback()) const {
+        ValidationResult result;
+        const int num_verts = int(m_vertices.size()), num_edges = int(m_edges.size()), num_faces = int(m_faces.size());
+        if (m_out_offsets.size() != m_vertices.size() + 1 || m_triangles.size() != 3 * m_faces.size()) {
+            result.issues.push_back(std::make_pair(MeshIssue::Tables, -1));
+            return result;
+        }
+        const int threads = MIN<int>(NumThreads(num_threads), (num_verts + num_edges + num_faces) / 65536 + 1);
+        IssueCollector found(threads);
+        auto owned = [&](const HE_edge *e) { return e && e->id >= 0 && e->id < num_edges && m_edges[e->id] == e; };
+        auto owned_vert = [&](const HE_vert *v) {
+            return v && v->index >= 0 && v->index < num_verts && m_vertices[v->index] == v;
+        };
+        // fraction of the elements swept so far, edges first, then vertices and faces
+        const float total = float(MAX(num_verts + num_edges + num_faces, 1));
+        auto stop = [&](int swept) {
+            if (!progress || progress(0.95f * float(swept) / total)) return false;
+            found.MergeInto(result);
+            result.canceled = true;
+            return true;
+        };
+        ParallelFor(0, num_edges, [&](std::size_t b, std::size_t end, int t) {
+            for (int i = int(b); i < int(end); ++i) {
+                const HE_edge *e = m_edges[i];
+                if (e->id != i) found.Add(t, MeshIssue::EdgeId, i);
+                if (!owned(e->pair) || e->pair == e || e->pair->pair != e) {
+                    found.Add(t, MeshIssue::EdgePair, i);
+                    continue;
+                }
+                if (!owned_vert(e->vert) || !owned_vert(e->pair->vert) || e->vert == e->pair->vert) {
+                    found.Add(t, MeshIssue::EdgeVertex, i);
+                    continue;
+                }
+                if (e->face == nullptr) {
+                    if (e->next || e->prev) found.Add(t, MeshIssue::EdgeBoundary, i);
+                    continue;
+                }
+                const HE_edge *n = e->next, *p = e->prev;
+                if (!owned(n) || !owned(p) || n->prev != e || p->next != e || n->next != p ||
+                    n->face != e->face || p->face != e->face) {
+                    found.Add(t, MeshIssue::EdgeLoop, i);
+                    continue;
+                }
+                if (p->vert != e->pair->vert) found.Add(t, MeshIssue::Orientation, i);
+            }
+        }, threads);
+        if (stop(num_edges)) return result;
+        ParallelFor(0, num_verts, [&](std::size_t b, std::size_t end, int t) {
+            for (int i = int(b); i < int(end); ++i) {
+                const HE_vert *v = m_vertices[i];
+                if (v->index != i) {
+                    found.Add(t, MeshIssue::VertexIndex, i);
+                    continue;
+                }
+                const int row = m_out_offsets[i + 1] - m_out_offsets[i];
+                if (v->edge == nullptr) {
+                    if (row > 0) found.Add(t, MeshIssue::VertexEdge, i);
+                    continue;
+                }
+                const HE_edge *start = v->edge;
+                if (!owned(start) || !owned(start->pair) || start->pair->vert != v) {
+                    found.Add(t, MeshIssue::VertexEdge, i);
+                    continue;
+                }
+                bool on_boundary = false;
+                for (int k = m_out_offsets[i]; k < m_out_offsets[i + 1]; ++k) {
+                    if (m_out_edges[k]->face == nullptr) on_boundary = true;
+                }
+                if (on_boundary && start->pair->face != nullptr) {
+                    found.Add(t, MeshIssue::VertexBoundary, i);
+                    continue;
+                }
+                // the same walk as VertexCirculator, bounded by the size of the table row
+                int steps = 0;
+                const HE_edge *cur = start;
+                while (cur && steps <= row) {
+                    if (!owned(cur) || !owned(cur->pair) || cur->pair->vert != v) break;
+                    ++steps;
+                    const HE_edge *next;
+                    if (!on_boundary) next = cur->pair->next;
+                    else next = cur->prev ? cur->prev->pair : nullptr;
+                    if (next == start) {
+                        cur = nullptr;
+                        break;
+                    }
+                    if (next == nullptr && !on_boundary) break;
+                    cur = next;
+                }
+                if (cur != nullptr || steps != row) found.Add(t, MeshIssue::OutEdges, i);
+            }
+        }, threads);
+        if (stop(num_edges + num_verts)) return result;
+        ParallelFor(0, num_faces, [&](std::size_t b, std::size_t end, int t) {
+            for (int i = int(b); i < int(end); ++i) {
+                const HE_face *f = m_faces[i];
+                const HE_edge *e = f->edge;
+                if (!owned(e) || e->face != f || !owned(e->next) || !owned(e->next->next) || !owned(e->pair) ||
+                    e->next->face != f || e->next->next->face != f || e->next->next->next != e) {
+                    found.Add(t, MeshIssue::FaceEdge, i);
+                    continue;
+                }
+                const HE_vert *corner[3] = {e->pair->vert, e->vert, e->next->vert};
+                bool ok = true;
+                for (int k = 0; k < 3; ++k) {
+                    ok = ok && owned_vert(corner[k]) && m_triangles[3*i + k] == corner[k]->index;
+                }
+                // vertid may start at any corner, but must run the same way round
+                int r = 0;
+                while (ok && r < 3 && f->vertid[r] != corner[0]->id) ++r;
+                ok = ok && r < 3 && f->vertid[(r + 1) % 3] == corner[1]->id && f->vertid[(r + 2) % 3] == corner[2]->id;
+                if (!ok) found.Add(t, MeshIssue::FaceVertices, i);
+            }
+        }, threads);
+        if (stop(num_edges + num_verts + num_faces)) return result;
+        found.MergeInto(result);
+        std::vector<int> dups;
+        FindDuplicateIds(m_vertices.size(), [&](std::size_t i) { return m_vertices[i]->id; }, threads, dups);
+        for (int id : dups) result.issues.push_back(std::make_pair(MeshIssue::DuplicateVertexId, id));
+        dups.clear();
+        FindDuplicateIds(m_faces.size(), [&](std::size_t i) { return m_faces[i]->id; }, threads, dups);
+        for (int id : dups) result.issues.push_back(std::make_pair(MeshIssue::DuplicateFaceId, id));
+        if (progress) progress(1.f);
+        return result;
     }
 
 protected:
 
-	// The following global method assumes that the graph is not complete and the edges are not added.
-	void UpdateAdjacencyGlobal() {
-        if (m_adjacency_info->isUpdated)
-			return;
-		m_adjacency_info->UpdateAdjacencyInfo();
-	}
-
-	// Given a face, add all edges around if not exists.
-	// The time complexity is O(E) since `LookUpHalfEdgeGlobal` is used.  The insertion is O(1).
-	// Here we discuss the various implementation that may reduce O(E) to O(log(E)).
-	// In fact using adjacent info such as a map this is possible, but the essence of `AdjacencyInfo`
-	// is that it is constructed once and for all, namely that we should not lookup and modify simultaneously.
-	// The second workaround is to store edges directly in a set/map, then the complexity of insertion and 
-	// lookup are both O(log(E)).
-	void AddFaceEdgesGlobal(HE_face *face) {
-		assert(face != nullptr && "TriMesh.AddFaceEdgesGlobal: Input `face` is nullptr.");
-		assert(m_adjacency_info != nullptr && m_adjacency_info->isUpdated == true &&
-			"TriMesh.CreateEdgesGlobal: Adjacency map is not initialized.");
-		if (face->edge != nullptr) {
-			printf("TriMesh.AddFaceEdgesGlobal: The edges are already inserted.\n");
-			return;
-		}
-		std::array<HE_vert*, 3> &fvertices = m_adjacency_info->fvert.at(face);
-		HE_edge *e0 = LookUpHalfEdgeGlobal(fvertices[0], fvertices[1]);
-		HE_edge *e1 = LookUpHalfEdgeGlobal(fvertices[1], fvertices[2]);
-		HE_edge *e2 = LookUpHalfEdgeGlobal(fvertices[2], fvertices[0]);
-		if (e0 == nullptr) {
-			if (e1 == nullptr) {
-				if (e2 == nullptr) { // all null.
-					InsertTopology(fvertices[0], fvertices[1], fvertices[2], face);
-				} else {	// e0, e1 null, e2 is not.
-					InsertTopology(e2, fvertices[1], face);
-				}
-			} else if (e2 == nullptr) { // e0, e2 null, e1 is not.
-				InsertTopology(e1, fvertices[0], face);
-			} else { // e0 null, e1, e2 is not.
-				InsertTopology(e1, e2, face);
+	// Run the normal kernels on the given faces, then on the given vertices (all of them for nullptr),
+	// and copy the results to the elements.  Positions are taken from the normal cache.
+	void UpdateNormals(const int *faces, int num_faces, const int *verts, int num_verts, int threads) {
+		NormalCache &nc = m_normal_cache;
+		++m_revision;
+		ParallelFor(0, num_faces, [&](std::size_t b, std::size_t e, int) {
+			ComputeFaceNormals(nc.px.data(), nc.py.data(), nc.pz.data(), m_triangles.data(), faces, int(b), int(e),
+							   nc.weighting, nc.fnx.data(), nc.fny.data(), nc.fnz.data(), nc.cw.data());
+			for (std::size_t j = b; j < e; ++j) {
+				const int f = faces ? faces[j] : int(j);
+				m_faces[f]->nx = nc.fnx[f];
+				m_faces[f]->ny = nc.fny[f];
+				m_faces[f]->nz = nc.fnz[f];
 			}
-		} else if (e1 == nullptr) {
-			if (e2 == nullptr) { // e1, e2 is null, e0 is not.
-				InsertTopology(e0, fvertices[2], face);
-			} else { // e1 is null, e0, e2 is not.
-				InsertTopology(e0, e2, face);
+		}, threads);
+		ParallelFor(0, num_verts, [&](std::size_t b, std::size_t e, int) {
+			ComputeVertexNormals(m_corner_offsets.data(), m_corners.data(), nc.fnx.data(), nc.fny.data(), nc.fnz.data(),
+								 nc.cw.data(), verts, int(b), int(e), nc.vnx.data(), nc.vny.data(), nc.vnz.data());
+			for (std::size_t j = b; j < e; ++j) {
+				const int v = verts ? verts[j] : int(j);
+				m_vertices[v]->nx = nc.vnx[v];
+				m_vertices[v]->ny = nc.vny[v];
+				m_vertices[v]->nz = nc.vnz[v];
 			}
-		} else if (e2 == nullptr) { // e2 is null, e0, e1 is not.
-			InsertTopology(e0, e1, face);
-		} else { // e0, e1, e2 is not null.
-			InsertTopology(e0, e1, e2, face);
-		}
+		}, threads);
 	}
 
-	// This function assumes that the edges around `face` are all nullptr.
-	// always v0->e0->v1->e1->v2->e2->v0
-	void InsertTopology(HE_vert *v0, HE_vert *v1, HE_vert *v2, HE_face *face) {
-		assert(v0 && v1 && v2 && face &&
-			"TriMesh.InsertTopology: Input nullptr");
-		HE_edge *e0 = InsertEdge(GetUniqueId<int>());
-		HE_edge *e1 = InsertEdge(GetUniqueId<int>());
-		HE_edge *e2 = InsertEdge(GetUniqueId<int>());
-		e0->pair = InsertEdge(GetUniqueId<int>());
-		e1->pair = InsertEdge(GetUniqueId<int>());
-		e2->pair = InsertEdge(GetUniqueId<int>());
-		e0->vert = v1;
-		e1->vert = v2;
-		e2->vert = v0;
-		e0->pair->vert = v0;
-		e1->pair->vert = v1;
-		e2->pair->vert = v2;
-		e0->pair->pair = e0;
-		e1->pair->pair = e1;
-		e2->pair->pair = e2;
-		e0->next = e1;
-		e1->next = e2;
-		e2->next = e0;
-		e0->prev = e2;
-		e1->prev = e0;
-		e2->prev = e1;
-		e0->face = face;
-		e1->face = face;
-		e2->face = face;
-		face->edge = e0;
-		v0->edge = e0;
-		v1->edge = e1;
-		v2->edge = e2;
-		v0->out_edge.push_front(e0);
-		v1->out_edge.push_front(e1);
-		v2->out_edge.push_front(e2);
-        v0->out_edge.push_front(e2->pair);
-		v1->out_edge.push_front(e0->pair);
-		v2->out_edge.push_front(e1->pair);
-	}
-
-	// This function assumes the opposite edge of `v2` is not empty, and the other edges are all empty.
-	void InsertTopology(HE_edge *e0, HE_vert *v2, HE_face *face) {
-		assert(e0 != nullptr && v2 != nullptr && face != nullptr &&
-			"TriMesh.InsertTopology: Input nullptr");
-		assert(e0->pair && "TriMesh.InsertTopology: Edges are not properly initialized.");
-		assert((e0->face == nullptr) ^ (e0->pair->face == nullptr) &&	// exactly one of the faces should be empty
-			"TriMesh.InsertTopology: Non-manifold case occur!");
-		if (e0->face != nullptr) e0 = e0->pair; // Find the right orientation.
-		HE_vert *v0 = e0->pair->vert;
-		HE_vert *v1 = e0->vert;
-		assert(v0 != nullptr && v1 != nullptr && "TriMesh.InsertTopology: Vertices are not properly initialized.");
-		assert(std::find(v0->out_edge.begin(), v0->out_edge.end(), e0) != v0->out_edge.end() &&
-			"TriMesh.InsertTopology: Out edges are not containes at the list.");
-		assert(std::find(v1->out_edge.begin(), v1->out_edge.end(), e0->pair) != v1->out_edge.end() &&
-			"TriMesh.InsertTopology: Out edges are not containes at the list.");
-		HE_edge *e1 = InsertEdge(GetUniqueId<int>());
-		HE_edge *e2 = InsertEdge(GetUniqueId<int>());
-		e1->pair = InsertEdge(GetUniqueId<int>());
-		e2->pair = InsertEdge(GetUniqueId<int>());
-		e1->vert = v2;
-		e2->vert = v0;
-		e1->pair->vert = v1;
-		e2->pair->vert = v2;
-		e1->pair->pair = e1;
-		e2->pair->pair = e2;
-		e0->next = e1;
-		e1->next = e2;
-		e2->next = e0;
-		e0->prev = e2;
-		e1->prev = e0;
-		e2->prev = e1;
-		e0->face = face;
-		e1->face = face;
-		e2->face = face;
-		face->edge = e0;
-		v0->edge = e0;
-		v1->edge = e1;
-		v2->edge = e2;
-        v0->out_edge.push_front(e2->pair);
-		v1->out_edge.push_front(e1);
-        v2->out_edge.push_front(e1->pair);
-		v2->out_edge.push_front(e2);
-	}
-
-	// This function assumes that `e0` and `e1` are not empty, and the remaining edge is empty.
-	// We want e0->v1->e1
-	void InsertTopology(HE_edge *e0, HE_edge *e1, HE_face *face) {
-		assert(e0 != nullptr && e1 != nullptr && face != nullptr &&
-			"TriMesh.InsertTopology: Input nullptr");
-		assert(e0->pair && "TriMesh.InsertTopology: Edges are not properly initialized.");
-		assert(e1->pair && "TriMesh.InsertTopology: Edges are not properly initialized.");
-		assert((e0->face == nullptr) ^ (e0->pair->face == nullptr) &&		// exactly one of the faces should be empty
-			"TriMesh.InsertTopology: Non-manifold case occur!");		
-		assert((e1->face == nullptr) ^ (e1->pair->face == nullptr) &&
-			"TriMesh.InsertTopology: Non-manifold case occur!");
-		if (e0->face) e0 = e0->pair;
-		if (e1->face) e1 = e1->pair;
-		assert(e0->vert);
-		if (e0->vert != e1->pair->vert) { // = v1
-			assert(e0->pair->vert == e1->vert);
-			HE_edge *t = e0; e0 = e1; e1 = t; // swap for ease.
-		}
-		HE_vert *v0 = e0->pair->vert;
-		HE_vert *v1 = e0->vert;
-		HE_vert *v2 = e1->vert;
-		assert(v0 && v2 && "TriMesh.InsertTopology: Invalid topology.");
-		assert(std::find(v0->out_edge.begin(), v0->out_edge.end(), e0) != v0->out_edge.end());
-		assert(std::find(v1->out_edge.begin(), v1->out_edge.end(), e1) != v1->out_edge.end());
-		assert(std::find(v2->out_edge.begin(), v2->out_edge.end(), e1->pair) != v2->out_edge.end());
-		assert(std::find(v1->out_edge.begin(), v1->out_edge.end(), e0->pair) != v1->out_edge.end());
-		HE_edge *e2 = InsertEdge(GetUniqueId<int>());
-		e2->pair = InsertEdge(GetUniqueId<int>());
-		e2->vert = v0;
-		e2->pair->vert = v2;
-		e2->pair->pair = e2;
-		e0->next = e1;
-		e1->next = e2;
-		e2->next = e0;
-		e0->prev = e2;
-		e1->prev = e0;
-		e2->prev = e1;
-		e0->face = face;
-		e1->face = face;
-		e2->face = face;
-		face->edge = e0;
-		v0->edge = e0;
-		v1->edge = e1;
-		v2->edge = e2;
-		v2->out_edge.push_front(e2);
-		v0->out_edge.push_front(e2->pair);
-	}
-
-	// This function assumes that `e0` and `e1` and `e2` are not empty.
-	void InsertTopology(HE_edge *e0, HE_edge *e1, HE_edge *e2, HE_face *face) {
-		assert(e0 != nullptr && e1 != nullptr && e2 != nullptr && face != nullptr &&
-			"TriMesh.InsertTopology: Input nullptr");
-		assert(e0->pair && "TriMesh.InsertTopology: Edges are not properly initialized.");
-		assert(e1->pair && "TriMesh.InsertTopology: Edges are not properly initialized.");
-		assert(e2->pair && "TriMesh.InsertTopology: Edges are not properly initialized.");
-		assert((e0->face == nullptr) ^ (e0->pair->face == nullptr) &&	// exactly one of the faces should be empty
-			"TriMesh.InsertTopology: Non-manifold case occur!");
-		assert((e1->face == nullptr) ^ (e1->pair->face == nullptr) &&
-			"TriMesh.InsertTopology: Non-manifold case occur!");
-		assert((e2->face == nullptr) ^ (e2->pair->face == nullptr) &&
-			"TriMesh.InsertTopology: Non-manifold case occur!");
-		if (e0->face) e0 = e0->pair;
-		if (e1->face) e1 = e1->pair;
-		if (e2->face) e2 = e2->pair;
-		assert(e0->vert && e1->vert && e2->vert);
-		// still we want e0->v1->e1->v2->e2->v0->e0
-		if (e0->vert != e1->pair->vert) { // =v1
-			assert(e0->pair->vert == e1->vert);
-			assert(e1->pair->vert == e2->vert);
-			assert(e2->pair->vert == e0->vert);
-			HE_edge *t = e1; e1 = e2; e2 = t;
-		} else {
-			assert(e1->vert == e2->pair->vert);
-			assert(e2->vert == e0->pair->vert);
-		}
-		HE_vert *v0 = e2->vert;
-		HE_vert *v1 = e0->vert;
-		HE_vert *v2 = e1->vert;
-		assert(std::find(v0->out_edge.begin(), v0->out_edge.end(), e0) != v0->out_edge.end());
-		assert(std::find(v1->out_edge.begin(), v1->out_edge.end(), e1) != v1->out_edge.end());
-		assert(std::find(v2->out_edge.begin(), v2->out_edge.end(), e2) != v2->out_edge.end());
-		assert(std::find(v0->out_edge.begin(), v0->out_edge.end(), e2->pair) != v0->out_edge.end());
-		assert(std::find(v1->out_edge.begin(), v1->out_edge.end(), e0->pair) != v1->out_edge.end());
-		assert(std::find(v2->out_edge.begin(), v2->out_edge.end(), e1->pair) != v2->out_edge.end());
-		e0->next = e1;
-		e1->next = e2;
-		e2->next = e0;
-		e0->prev = e2;
-		e1->prev = e0;
-		e2->prev = e1;
-		e0->face = face;
-		e1->face = face;
-		e2->face = face;
-		face->edge = e0;
-		v0->edge = e0;
-		v1->edge = e1;
-		v2->edge = e2;
+	void ClearDirty() {
+		for (int v : m_dirty.verts) m_dirty.flag[v] = 0;
+		m_dirty.verts.clear();
+	}
+
+	// The following global method assumes that the graph is not complete and the edges are not added.
+	bool UpdateAdjacencyGlobal(const ProgressCallback &progress = ProgressCallback()) {
+        if (m_adjacency_info->isUpdated)
+			return true;
+		return m_adjacency_info->UpdateAdjacencyInfo(progress);
 	}
 
 	// Look for the specific half-edge vfrom -> vto.  Return nullptr if not exists.
 	// Since the lookup is among all edges stored, the time complexity is O(E).
-    // Update: The complexity has been reduced to O(1).
+    // Update: The complexity has been reduced to O(valence), scanning one row of the out edge table.
 	HE_edge *LookUpHalfEdgeGlobal(HE_vert *vfrom, HE_vert *vto) const {
 		assert(vfrom != nullptr && "TriMesh.LookUpHalfEdgeGlobal: Input `from` vertex is nullptr.");
 		assert(vto   != nullptr && "TriMesh.LookUpHalfEdgeGlobal: Input `to` vertex is nullptr.");
-		for (auto it = vfrom->out_edge.begin(); it != vfrom->out_edge.end(); ++it) {
+		auto out = GetOutEdgeTable(vfrom);
+		for (auto it = out.first; it != out.second; ++it) {
 			if ((*it)->vert == vto) return *it;
 		}
 		return nullptr;
@@ -616,117 +1149,90 @@ public:
 		return std::end(m_faces);
 	}
 
+	// Element at position `i` of the vertex/face list, e.g. from the corner or component tables.
+	HE_vert *GetVertex(std::size_t i) {
+		assert(i < m_vertices.size() && "TriMesh.GetVertex: Index out of range.");
+		return m_vertices[i];
+	}
+	HE_face *GetFace(std::size_t i) {
+		assert(i < m_faces.size() && "TriMesh.GetFace: Index out of range.");
+		return m_faces[i];
+	}
+
+	// Walk around `v` from v->edge.  A boundary vertex points to the out edge whose pair is on boundary
+	// (see AddEdgesGlobal), so its walk goes the other way round and ends with the boundary out edge.
+	static HalfEdgeCirculator VertexCirculator(const HE_vert *v) {
+		assert(v && "TriMesh.VertexCirculator: Input nullptr.");
+		if (v->edge == nullptr) return HalfEdgeCirculator();
+		assert(v->edge->pair && v->edge->pair->vert == v &&
+			"TriMesh.VertexCirculator: Vertex pointing to an edge that is not an out edge.");
+		return HalfEdgeCirculator(v->edge, v->edge->pair->face ? HalfEdgeCirculator::VertexRing
+																: HalfEdgeCirculator::BoundaryRing);
+	}
+
+	static HalfEdgeCirculator FaceCirculator(const HE_face *f) {
+		assert(f && f->edge && "TriMesh.FaceCirculator: Input nullptr.");
+		return HalfEdgeCirculator(f->edge, HalfEdgeCirculator::FaceLoop);
+	}
+
+	// Allocation free neighborhoods, in the same order as the vector versions below.
+	ElementRange<HalfEdgeOf> VertexOutEdges(const HE_vert *v) const { return ElementRange<HalfEdgeOf>(VertexCirculator(v)); }
+	ElementRange<PairOf> VertexInEdges(const HE_vert *v) const { return ElementRange<PairOf>(VertexCirculator(v)); }
+	ElementRange<VertOf> VertexVertices(const HE_vert *v) const { return ElementRange<VertOf>(VertexCirculator(v)); }
+	ElementRange<FaceOf> VertexFaces(const HE_vert *v) const { return ElementRange<FaceOf>(VertexCirculator(v)); }
+	ElementRange<HalfEdgeOf> FaceEdges(const HE_face *f) const { return ElementRange<HalfEdgeOf>(FaceCirculator(f)); }
+	ElementRange<VertOf> FaceVertices(const HE_face *f) const { return ElementRange<VertOf>(FaceCirculator(f)); }
+	ElementRange<PairFaceOf> FaceFaces(const HE_face *f) const { return ElementRange<PairFaceOf>(FaceCirculator(f)); }
+
 	// get all the adjacent vertices to vertex `v`.
 	std::vector<HE_vert*> GetVertexVertices(HE_vert *v) {
 		assert(v && "TriMesh.GetVertexVertices: Input nullptr.");
-		std::vector<HE_edge*> out_edges = GetVertexOutEdges(v);
-		auto out_vertices = std::vector<HE_vert*>(out_edges.size());
-		std::transform(out_edges.begin(), out_edges.end(), out_vertices.begin(),
-			[](HE_edge *e) {return e->vert;});
-		assert(std::all_of(out_vertices.begin(), out_vertices.end(), [](HE_vert *v){return v != nullptr;}) &&
-			"TriMesh.GetVertexVertices: Output nullptr.");
-		return out_vertices;
+		auto range = VertexVertices(v);
+		return std::vector<HE_vert*>(range.begin(), range.end());
 	}
 
 	std::vector<HE_edge*> GetVertexInEdges(HE_vert *v) {
 		assert(v && "TriMesh.GetVertexInEdges: Input nullptr.");
-		std::vector<HE_edge*> out_edges = GetVertexOutEdges(v);
-		auto in_edges = std::vector<HE_edge*>(out_edges.size());
-		std::transform(out_edges.begin(), out_edges.end(), in_edges.begin(),
-			[](HE_edge *e) {return e->pair;});
-		assert(std::all_of(in_edges.begin(), in_edges.end(), [](HE_edge *e){return e != nullptr;}) &&
-			   "TriMesh.GetVertexInEdges: Output nullptr.");
-		return in_edges;
+		auto range = VertexInEdges(v);
+		return std::vector<HE_edge*>(range.begin(), range.end());
 	}
 
+	// Closed vertices: v->edge, then around through pair->next.  Boundary vertices: from the out edge whose
+	// pair is on boundary, around through prev->pair, ending with the out edge on boundary.
 	std::vector<HE_edge*> GetVertexOutEdges(HE_vert *v) {
 		assert(v && "TriMesh.GetVertexOutEdges: Input nullptr.");
-		auto out_edges = std::vector<HE_edge*>{};
 		if (v->edge == nullptr) {
 			printf("TriMesh.GetVertexOutEdges: Vertex pointing to nothing.");
-			return out_edges;
+			return std::vector<HE_edge*>{};
 		}
-		// v->edge should be guaranteed that it is an out edge as well.
-		assert(v->edge->pair && v->edge->pair->vert == v &&
-			"TriMesh.GetVertexOutEdges: Vertex pointing to an edge that is not an out edge.");
-		HE_edge *e = v->edge;
-		do {
-			assert(e->pair && "TriMesh.GetVertexOutEdges: Edges are not in pairs.");
-			assert(e->pair->vert && e->pair->vert->id == v->id && "TriMesh.GetVertexOutEdges: Vertex not pointing to an out edge.");
-			out_edges.push_back(e);
-			e = e->pair;
-			if (e->next)
-				e = e->next;
-			else
-				break;
-		} while (e->id != v->edge->id);
-		if (e && e->id == v->edge->id)
-			return out_edges;
-		else
-			assert(e->next == nullptr && e->prev == nullptr && EdgeOnBoundary(e) &&
-						   "TriMesh.GetVertexOutEdges: Boundary edge pointing to some face.");
-		// Otherwise, some edges should be on boundary.
-		out_edges.clear();
-		assert(e->vert->id == v->id && "TriMesh.GetVertexOutEdges: e should be an in-edge");
-		while (e) {
-			assert(e->pair && "TriMesh.GetVertexOutEdges: Edges are not in pairs.");
-			assert(e->vert && e->vert->id == v->id && "TriMesh.GetVertexOutEdges: e is not an in-edge.");
-			out_edges.push_back(e->pair);
-			e = e->pair->prev;
-		}
-		return out_edges;
-
+		auto range = VertexOutEdges(v);
+		return std::vector<HE_edge*>(range.begin(), range.end());
 	}
 
 	std::vector<HE_face *> GetVertexFaces(HE_vert *v) {
 		assert(v && "TriMesh.GetVertexFaces: Input nullptr.");
-		auto out_edges = GetVertexOutEdges(v);
-		auto vfaces = std::vector<HE_face*>(out_edges.size());
-		std::transform(out_edges.begin(), out_edges.end(), vfaces.begin(),
-					   [](HE_edge *e) {return e->face;});
-		vfaces.erase(std::remove_if(vfaces.begin(), vfaces.end(), [](HE_face *f){return f == nullptr;}), vfaces.end());
-		assert(std::all_of(vfaces.begin(), vfaces.end(), [](HE_face *f) {return f != nullptr;}) &&
-			"TriMesh.GetVertexFaces: Output nullptr.");
-		return vfaces;
+		auto range = VertexFaces(v);
+		return std::vector<HE_face*>(range.begin(), range.end());
 	}
 
 	std::vector<HE_vert *> GetFaceVertices(HE_face *f) {
 		assert(f && f->edge && "TriMesh.GetFaceVertices: Input nullptr.");
-		auto fedges = GetFaceEdges(f);
-		auto fverts = std::vector<HE_vert *>(fedges.size());
-		std::transform(fedges.begin(), fedges.end(), fverts.begin(),
-						[](HE_edge *e) {return e->vert;});
-		assert(std::all_of(fverts.begin(), fverts.end(), [](HE_vert *v) {return v != nullptr;}) &&
-			"TriMesh.GetFaceVertices: Output nullptr.");
-		return fverts;
+		auto range = FaceVertices(f);
+		return std::vector<HE_vert*>(range.begin(), range.end());
 	}
 
 	std::vector<HE_edge *> GetFaceEdges(HE_face *f) {
 		assert(f && f->edge && "TriMesh.GetFaceEdges: Input nullptr.");
-		auto fedges = std::vector<HE_edge *>{};
-		HE_edge *e = f->edge;
-		do {
-			fedges.push_back(e);
-			assert(e->next && "TriMesh.GetFaceEdges: Edge inside a face has null next pointer.");
-			e = e->next;
-		} while (e != f->edge);
+		auto range = FaceEdges(f);
+		auto fedges = std::vector<HE_edge*>(range.begin(), range.end());
 		assert(fedges.size() == 3 && "TriMesh.GetFaceEdges: Face have edge number not equal to three.");	// trimesh
 		return fedges;
 	}
 
 	std::vector<HE_face *> GetFaceFaces(HE_face *f) {
 		assert(f && f->edge && "TriMesh.GetFaceFaces: Input nullptr.");
-		auto fedges = GetFaceEdges(f);
-		auto ffaces = std::vector<HE_face *>(fedges.size());
-		assert(std::all_of(fedges.begin(), fedges.end(), [](HE_edge *e) {return e && e->pair;}) &&
-			"TriMesh.GetFaceFaces: Edges have null pairs.");
-		std::transform(fedges.begin(), fedges.end(), ffaces.begin(),
-						[](HE_edge *e) {return e->pair->face;});
-		// remove all nullptrs
-		ffaces.erase(std::remove_if(ffaces.begin(), ffaces.end(),
-						[](HE_face *f) {return f == nullptr;}),
-					 ffaces.end());
-		return ffaces;
+		auto range = FaceFaces(f);
+		return std::vector<HE_face*>(range.begin(), range.end());
 	}
 
 
@@ -753,39 +1259,34 @@ public:
 private:
 
 	// Danger! Calling the following functions would make other elements pointing to them dangling! Use with care!
+	// The elements are released block by block instead of one delete per element.
 	void RemoveAllEdges() {
-		for (auto p : m_edges) {
-			if (p) {
-				delete p;
-				p = nullptr;
-			}
-		}
+		m_out_offsets.clear();
+		m_out_edges.clear();
+		m_triangles.clear();
+		m_corner_offsets.clear();
+		m_corners.clear();
+		m_component_faces.clear();
+		m_component_offsets.clear();
+		m_next_edge_id = 0;
 		m_edges.clear();
+		m_edge_pool.Clear();
 	}
 	void RemoveAllVertices() {
-		for (auto p : m_vertices) {
-			if (p) {
-				delete p;
-				p = nullptr;
-			}
-		}
 		m_vertices.clear();
+		m_vert_pool.Clear();
 	}
 	void RemoveAllFaces() {
-		for (auto p : m_faces) {
-			if (p) {
-				delete p;
-				p = nullptr;
-			}
-		}
 		m_faces.clear();
+		m_face_pool.Clear();
 	}
 
-	// Use temporarily for edges now.
-	template<typename IntType>
-	IntType GetUniqueId() {
-		static std::atomic<IntType> count_atomic(0);
-		return count_atomic.fetch_add(IntType(1));
+	// Reserve `count` consecutive edge ids and return the first one.  Ids are owned by the mesh and
+	// dense from 0, so they can index arrays, and meshes built on different threads share nothing.
+	int NewEdgeIds(int count = 1) {
+		int first = m_next_edge_id;
+		m_next_edge_id += count;
+		return first;
 	}
 
 
@@ -793,6 +1294,23 @@ private:
 	std::vector<HE_edge*> m_edges;
 	std::vector<HE_vert*> m_vertices;
 	std::vector<HE_face*> m_faces;
+	std::vector<int> m_out_offsets;		// out edge table, see BuildOutEdgeTable
+	std::vector<HE_edge*> m_out_edges;
+	std::vector<int> m_triangles;		// corner table, see BuildCornerTable
+	std::vector<int> m_corner_offsets;
+	std::vector<int> m_corners;
+	std::vector<int> m_component_faces;		// see GetComponentFaces
+	std::vector<int> m_component_offsets;
+	int m_next_edge_id;		// see NewEdgeIds
+	BuildReport m_build_report;
+	NormalCache m_normal_cache;
+	DirtyState m_dirty;
+	float m_bbox_min[3], m_bbox_max[3];	// see GetBoundingBox
+	bool m_bbox_valid;
+	std::size_t m_revision;		// see Revision
+	ElementPool<HE_edge> m_edge_pool;	// storage of the elements above
+	ElementPool<HE_vert> m_vert_pool;
+	ElementPool<HE_face> m_face_pool;
 	std::unique_ptr<AdjacencyInfo> m_adjacency_info;
 };
 
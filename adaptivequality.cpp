@@ -0,0 +1,35 @@
+#include "adaptivequality.h"
+
+AdaptiveQuality::AdaptiveQuality()
+    : m_enabled(true), m_interactive(false), m_level(0), m_too_slow(-1), m_fast_frames(0),
+      m_first_frame(0), m_target_ms(1000. / 60.)
+{}
+
+void AdaptiveQuality::BeginInteraction(long next_frame) {
+    m_interactive = true;
+    m_too_slow = -1;
+    m_fast_frames = 0;
+    m_first_frame = next_frame;
+}
+
+bool AdaptiveQuality::Adapt(long frame, double frame_ms, long next_frame) {
+    if (!m_enabled || !m_interactive || frame < m_first_frame) return false;
+    int level = m_level;
+    if (frame_ms > m_target_ms) {
+        m_fast_frames = 0;
+        if (m_level > m_too_slow) m_too_slow = m_level;    // and so are the levels below
+        if (m_level < kMaxLevel) level = m_level + 1;
+    } else if (frame_ms < 0.5 * m_target_ms && m_level - 1 > m_too_slow) {
+        if (++m_fast_frames >= kFastFrames) level = m_level - 1;
+    } else {
+        m_fast_frames = 0;
+    }
+    if (level == m_level) {
+        m_first_frame = frame + 1;  // each frame counts once
+        return false;
+    }
+    m_level = level;
+    m_fast_frames = 0;
+    m_first_frame = next_frame;
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef ADAPTIVEQUALITY_H
+#define ADAPTIVEQUALITY_H
+
+// Detail level of the view while the user drags it.  Level 0 is full quality, level 1 drops the
+// wireframe, and from level 2 on the mesh is drawn as a point subset of every PointStep()-th vertex.
+// The level is raised as soon as an interactive frame takes longer than the target, and lowered again
+// after a few frames well below it, but never back to a level that was too slow during the same
+// interaction.  The level reached is kept for the next interaction.
+// Frames are identified by FrameProfiler frame numbers, whose times are reported a few frames late.
+class AdaptiveQuality
+{
+public:
+    enum {kMaxLevel = 8};
+
+    AdaptiveQuality();
+
+    void SetEnabled(bool enabled) { m_enabled = enabled; }
+    bool IsEnabled() const { return m_enabled; }
+    void SetTargetMs(double ms) { m_target_ms = ms; }
+    double TargetMs() const { return m_target_ms; }
+
+    // Frames from `next_frame` on are drawn at Level() until EndInteraction().
+    void BeginInteraction(long next_frame);
+    void EndInteraction() { m_interactive = false; }
+    bool IsInteractive() const { return m_interactive; }
+
+    // Level to draw the current frame at, 0 unless interacting.
+    int Level() const { return (m_enabled && m_interactive) ? m_level : 0; }
+    bool DrawsWireframe() const { return Level() == 0; }
+    // 1 at levels 0 and 1, then doubling with every level.
+    int PointStep() const { return Level() < 2 ? 1 : 1 << (Level() - 1); }
+
+    // Account for the measured cost of `frame`; frames seen before or drawn at another level are ignored.
+    // Return true if the level has changed, in which case frames before `next_frame` are not taken into
+    // account anymore.
+    bool Adapt(long frame, double frame_ms, long next_frame);
+
+private:
+    enum {kFastFrames = 3};     // frames below half the target before the level is lowered
+
+    bool m_enabled;
+    bool m_interactive;
+    int m_level;
+    int m_too_slow;         // highest level found too slow during this interaction, -1 if none
+    int m_fast_frames;
+    long m_first_frame;     // first frame at m_level that has not been accounted for
+    double m_target_ms;
+};
+
+#endif // ADAPTIVEQUALITY_H
@@ -3,6 +3,10 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdexcept>
+#include <stdlib.h>
+#include <thread>
+#include <functional>
+#include <vector>
 
 #define NotImplemented do{\
     throw std::runtime_error("Not implemented!"); \
@@ -13,15 +17,15 @@ static data_type MIN(data_type a, data_type b) { return a<b ? a : b; }
 template <typename data_type>
 static data_type MAX(data_type a, data_type b) { return a>b ? a : b; }
 
-// timing utility
-static clock_t tp = clock();
+// timing utility, one timer per thread so that concurrent loads do not share it
+inline thread_local clock_t tp = clock();
 
-static clock_t *tic() {
+inline clock_t *tic() {
     tp = clock();
     return &tp;
 }
 
-static double toc(const clock_t *t = nullptr) {
+inline double toc(const clock_t *t = nullptr) {
     if (t != nullptr) {
         return static_cast<double>(clock() - *t) / CLOCKS_PER_SEC;
     } else {
@@ -31,6 +35,46 @@ static double toc(const clock_t *t = nullptr) {
    }
 }
 
+// Number of worker threads to use.  A positive `requested` value is used as is, otherwise
+// the environment variable MESHVIEWER_THREADS is consulted, and finally the number of cores.
+inline int NumThreads(int requested = 0) {
+    if (requested > 0) return requested;
+    const char *env = getenv("MESHVIEWER_THREADS");
+    if (env != nullptr && atoi(env) > 0) return atoi(env);
+    int hw = static_cast<int>(std::thread::hardware_concurrency());
+    return hw > 0 ? hw : 1;
+}
+
+// Progress report of a long running operation, with `fraction` in [0, 1].
+// Returning false asks the operation to stop as soon as possible.
+typedef std::function<bool(float fraction)> ProgressCallback;
+
+// `progress` for a stage covering [begin, end] of a longer operation.  Empty if `progress` is.
+inline ProgressCallback SubProgress(const ProgressCallback &progress, float begin, float end) {
+    if (!progress) return ProgressCallback();
+    return [progress, begin, end](float fraction) { return progress(begin + fraction * (end - begin)); };
+}
+
+// Split [begin, end) into `num_threads` contiguous ranges and call func(range_begin, range_end, thread_index)
+// for each of them in parallel.  The calling thread takes the first range.
+template <typename Func>
+static void ParallelFor(size_t begin, size_t end, Func func, int num_threads = 0) {
+    if (end <= begin) return;
+    size_t total = end - begin;
+    size_t n = MIN<size_t>(static_cast<size_t>(NumThreads(num_threads)), total);
+    if (n <= 1) {
+        func(begin, end, 0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(n - 1);
+    for (size_t i = 1; i < n; ++i) {
+        workers.emplace_back(func, begin + total*i/n, begin + total*(i+1)/n, static_cast<int>(i));
+    }
+    func(begin, begin + total/n, 0);
+    for (auto &w : workers) w.join();
+}
+
 // template for safely deleting pointers.
 template<typename Object>
 void SafeDelete(Object *obj) {
@@ -0,0 +1,53 @@
+#include "decorationbuffer.h"
+
+namespace {
+const int kVertexFloats = 6;    // x, y, z, r, g, b
+}
+
+DecorationBuffer::DecorationBuffer()
+    : m_vertices(), m_batches(), m_buffer(0)
+{}
+
+void DecorationBuffer::Begin(GLenum mode, GLfloat line_width) {
+    GLint first = GLint(m_vertices.size() / kVertexFloats);
+    m_batches.push_back(Batch{mode, line_width, first, 0});
+}
+
+void DecorationBuffer::Add(GLfloat x, GLfloat y, GLfloat z, GLfloat r, GLfloat g, GLfloat b) {
+    const GLfloat v[kVertexFloats] = {x, y, z, r, g, b};
+    m_vertices.insert(m_vertices.end(), v, v + kVertexFloats);
+    m_batches.back().count++;
+}
+
+void DecorationBuffer::Upload() {
+    if (m_buffer == 0) glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(GLfloat), m_vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    std::vector<GLfloat>().swap(m_vertices);
+}
+
+void DecorationBuffer::Draw() const {
+    if (m_buffer == 0) return;
+    const GLsizei stride = kVertexFloats * sizeof(GLfloat);
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_LINE_BIT);
+    glDisable(GL_LIGHTING);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(0));
+    glColorPointer(3, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(3 * sizeof(GLfloat)));
+    for (const Batch &batch : m_batches) {
+        glLineWidth(batch.line_width);
+        glDrawArrays(batch.mode, batch.first, batch.count);
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glPopAttrib();
+}
+
+void DecorationBuffer::Release() {
+    if (m_buffer) glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef DECORATIONBUFFER_H
+#define DECORATIONBUFFER_H
+
+#include <GL/glew.h>
+#include <vector>
+
+// Static unlit geometry drawn around the mesh (axes, ground grid), built once into one vertex buffer
+// of positions and colors.  Vertices are added in batches, each drawn by one glDrawArrays call with
+// its own primitive and line width.  Upload(), Draw() and Release() need the GL context to be current.
+class DecorationBuffer
+{
+public:
+    DecorationBuffer();
+    ~DecorationBuffer() {}  // the GL buffer is freed by Release(), while the context is alive
+
+    // Start a batch of `mode` primitives, drawn with `line_width` for lines.
+    void Begin(GLenum mode, GLfloat line_width = 1.f);
+    void Add(GLfloat x, GLfloat y, GLfloat z, GLfloat r, GLfloat g, GLfloat b);
+
+    bool IsUploaded() const { return m_buffer != 0; }
+    // Send the vertices added so far to the GPU and drop the CPU copy.
+    void Upload();
+    // Lighting is switched off while drawing; the enable, color and line states are restored afterwards.
+    void Draw() const;
+    void Release();
+
+private:
+    struct Batch {
+        GLenum mode;
+        GLfloat line_width;
+        GLint first;
+        GLsizei count;
+    };
+
+    std::vector<GLfloat> m_vertices;    // x, y, z, r, g, b until uploaded
+    std::vector<Batch> m_batches;
+    GLuint m_buffer;
+};
+
+#endif // DECORATIONBUFFER_H
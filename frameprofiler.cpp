@@ -0,0 +1,146 @@
+#include "frameprofiler.h"
+
+const char *FrameProfiler::StageName(int stage) {
+    static const char *const names[kNumStages] = {"update", "axes", "points", "edges", "faces", "bbox"};
+    return names[stage];
+}
+
+FrameProfiler::FrameProfiler()
+    : m_current(0), m_frame(0), m_gpu_timer(false), m_in_frame(false), m_log(nullptr)
+{
+    for (Slot &slot : m_slots) {
+        for (int s = 0; s < kNumStages; ++s) {
+            slot.queries[s] = 0;
+            slot.issued[s] = false;
+        }
+        slot.pending = false;
+    }
+    m_reported.frame = 0;
+    m_reported.frame_ms = 0.;
+    for (int s = 0; s < kNumStages; ++s) {
+        m_reported.cpu_ms[s] = 0.;
+        m_reported.gpu_ms[s] = -1.;
+    }
+}
+
+FrameProfiler::~FrameProfiler() {
+    if (m_log) fclose(m_log);
+}
+
+void FrameProfiler::Initialize() {
+    Release();
+    m_gpu_timer = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (!m_gpu_timer) {
+        printf("FrameProfiler.Initialize: GL_TIME_ELAPSED queries are not supported, GPU times are not measured.\n");
+        return;
+    }
+    for (Slot &slot : m_slots) glGenQueries(kNumStages, slot.queries);
+}
+
+void FrameProfiler::Release() {
+    for (Slot &slot : m_slots) {
+        if (slot.queries[0]) glDeleteQueries(kNumStages, slot.queries);
+        for (int s = 0; s < kNumStages; ++s) slot.queries[s] = 0;
+        slot.pending = false;
+    }
+    m_gpu_timer = false;
+    m_in_frame = false;
+}
+
+bool FrameProfiler::OpenLog(const std::string &filename) {
+    if (m_log) fclose(m_log);
+    m_log = fopen(filename.c_str(), "w");
+    if (!m_log) {
+        printf("FrameProfiler.OpenLog: Cannot open %s for writing.\n", filename.c_str());
+        return false;
+    }
+    fprintf(m_log, "frame,frame_cpu_ms");
+    for (int s = 0; s < kNumStages; ++s) fprintf(m_log, ",%s_cpu_ms", StageName(s));
+    for (int s = 0; s < kNumStages; ++s) fprintf(m_log, ",%s_gpu_ms", StageName(s));
+    fprintf(m_log, "\n");
+    return true;
+}
+
+double FrameProfiler::FrameGpuMs() const {
+    if (!m_gpu_timer) return -1.;
+    double sum = 0.;
+    for (int s = 0; s < kNumStages; ++s) sum += m_reported.gpu_ms[s];
+    return sum;
+}
+
+void FrameProfiler::BeginFrame() {
+    Collect(m_slots[m_current].pending);     // the slot is reused, its results are needed now
+    Slot &slot = m_slots[m_current];
+    slot.timing.frame = ++m_frame;
+    slot.timing.frame_ms = 0.;
+    for (int s = 0; s < kNumStages; ++s) {
+        slot.timing.cpu_ms[s] = 0.;
+        slot.timing.gpu_ms[s] = m_gpu_timer ? 0. : -1.;
+        slot.issued[s] = false;
+    }
+    m_in_frame = true;
+    m_frame_start = Clock::now();
+}
+
+// Stages must not overlap, since only one GL_TIME_ELAPSED query can be active at a time.
+void FrameProfiler::Begin(Stage stage) {
+    if (!m_in_frame) return;
+    Slot &slot = m_slots[m_current];
+    if (m_gpu_timer) {
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[stage]);
+        slot.issued[stage] = true;
+    }
+    m_stage_start[stage] = Clock::now();
+}
+
+void FrameProfiler::End(Stage stage) {
+    if (!m_in_frame) return;
+    Slot &slot = m_slots[m_current];
+    slot.timing.cpu_ms[stage] += std::chrono::duration<double, std::milli>(Clock::now() - m_stage_start[stage]).count();
+    if (m_gpu_timer) glEndQuery(GL_TIME_ELAPSED);
+}
+
+void FrameProfiler::EndFrame() {
+    if (!m_in_frame) return;
+    Slot &slot = m_slots[m_current];
+    slot.timing.frame_ms = std::chrono::duration<double, std::milli>(Clock::now() - m_frame_start).count();
+    slot.pending = true;
+    m_in_frame = false;
+    m_current = (m_current + 1) % kSlots;
+    Collect(false);
+}
+
+// Slots are visited from the oldest frame on, so frames are reported in order.
+void FrameProfiler::Collect(bool wait) {
+    for (int k = 0; k < kSlots; ++k) {
+        Slot &slot = m_slots[(m_current + k) % kSlots];
+        if (!slot.pending) continue;
+        if (m_gpu_timer && !wait) {
+            for (int s = 0; s < kNumStages; ++s) {
+                if (!slot.issued[s]) continue;
+                GLint available = 0;
+                glGetQueryObjectiv(slot.queries[s], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) return;
+            }
+        }
+        wait = false;   // only for the oldest one
+        for (int s = 0; s < kNumStages && m_gpu_timer; ++s) {
+            if (!slot.issued[s]) continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(slot.queries[s], GL_QUERY_RESULT, &ns);
+            slot.timing.gpu_ms[s] = double(ns) * 1e-6;
+        }
+        slot.pending = false;
+        Report(slot.timing);
+    }
+}
+
+void FrameProfiler::Report(const Timing &timing) {
+    m_reported = timing;
+    if (!m_log) return;
+    fprintf(m_log, "%ld,%.4f", timing.frame, timing.frame_ms);
+    for (int s = 0; s < kNumStages; ++s) fprintf(m_log, ",%.4f", timing.cpu_ms[s]);
+    for (int s = 0; s < kNumStages; ++s) fprintf(m_log, ",%.4f", timing.gpu_ms[s]);
+    fprintf(m_log, "\n");
+    fflush(m_log);
+}
@@ -0,0 +1,89 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <GL/glew.h>
+#include <chrono>
+#include <string>
+#include <stdio.h>
+
+// Per-frame timing of the render stages: CPU wall time of each stage, and GPU time measured with
+// GL_TIME_ELAPSED queries where the context supports them.  GPU results arrive a few frames late, so
+// queries rotate over kSlots frames and a frame is reported once all its queries are answered.
+// Reported frames can be streamed to a CSV file, one line per frame.
+// Initialize(), Release() and everything between BeginFrame() and EndFrame() need the GL context.
+class FrameProfiler
+{
+public:
+    enum Stage {Update, Axes, Points, Edges, Faces, BoundingBox, kNumStages};
+    static const char *StageName(int stage);
+
+    // Times one stage for as long as it lives.
+    class Scope {
+    public:
+        Scope(FrameProfiler &profiler, Stage stage) : m_profiler(profiler), m_stage(stage) { profiler.Begin(stage); }
+        ~Scope() { m_profiler.End(m_stage); }
+    private:
+        FrameProfiler &m_profiler;
+        Stage m_stage;
+    };
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    // Create the queries if GL_TIME_ELAPSED is supported.
+    void Initialize();
+    void Release();
+    bool HasGpuTimer() const { return m_gpu_timer; }
+
+    // Stream every reported frame to `filename` as CSV.  Return false if it cannot be opened.
+    bool OpenLog(const std::string &filename);
+
+    void BeginFrame();
+    // Number of the frame being recorded, or of the last one recorded between frames.
+    long CurrentFrame() const { return m_frame; }
+    void Begin(Stage stage);
+    void End(Stage stage);
+    void EndFrame();
+
+    // Times of the last reported frame in milliseconds.  GPU times are negative without a GPU timer.
+    long Frame() const { return m_reported.frame; }
+    double FrameCpuMs() const { return m_reported.frame_ms; }
+    double CpuMs(int stage) const { return m_reported.cpu_ms[stage]; }
+    double GpuMs(int stage) const { return m_reported.gpu_ms[stage]; }
+    double FrameGpuMs() const;
+
+private:
+    enum {kSlots = 4};
+    typedef std::chrono::steady_clock Clock;
+
+    struct Timing {
+        long frame;
+        double frame_ms;
+        double cpu_ms[kNumStages];
+        double gpu_ms[kNumStages];
+    };
+
+    struct Slot {
+        Timing timing;
+        GLuint queries[kNumStages];
+        bool issued[kNumStages];
+        bool pending;   // waiting for GPU results
+    };
+
+    // Report the oldest pending frames whose results are in; with `wait`, block for the oldest one.
+    void Collect(bool wait);
+    void Report(const Timing &timing);
+
+private:
+    Slot m_slots[kSlots];
+    int m_current;          // slot of the frame being recorded
+    long m_frame;
+    bool m_gpu_timer;
+    bool m_in_frame;
+    Clock::time_point m_frame_start;
+    Clock::time_point m_stage_start[kNumStages];
+    Timing m_reported;
+    FILE *m_log;
+};
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,83 @@
+#include "glstatecache.h"
+#include <algorithm>
+
+namespace {
+// Number of values of a glMaterialfv/glLightfv/glLightModelfv parameter.
+int NumParams(GLenum pname) {
+    switch (pname) {
+    case GL_SHININESS: case GL_SPOT_EXPONENT: case GL_SPOT_CUTOFF:
+    case GL_CONSTANT_ATTENUATION: case GL_LINEAR_ATTENUATION: case GL_QUADRATIC_ATTENUATION:
+    case GL_LIGHT_MODEL_LOCAL_VIEWER: case GL_LIGHT_MODEL_TWO_SIDE: case GL_LIGHT_MODEL_COLOR_CONTROL:
+        return 1;
+    case GL_SPOT_DIRECTION: case GL_COLOR_INDEXES:
+        return 3;
+    default:
+        return 4;
+    }
+}
+}
+
+GLStateCache::GLStateCache()
+    : m_state(), m_issued(0), m_skipped(0), m_last_issued(0), m_last_skipped(0)
+{}
+
+void GLStateCache::Invalidate() {
+    m_state.clear();
+}
+
+void GLStateCache::BeginFrame() {
+    m_last_issued = m_issued;
+    m_last_skipped = m_skipped;
+    m_issued = m_skipped = 0;
+}
+
+bool GLStateCache::Changed(Kind kind, GLenum a, GLenum b, const GLfloat *values, int n) {
+    std::vector<GLfloat> &stored = m_state[Key(kind, std::make_pair(a, b))];
+    if (stored.size() == size_t(n) && std::equal(values, values + n, stored.begin())) {
+        ++m_skipped;
+        return false;
+    }
+    stored.assign(values, values + n);
+    ++m_issued;
+    return true;
+}
+
+void GLStateCache::Enable(GLenum cap, bool on) {
+    const GLfloat value = on ? 1.f : 0.f;
+    if (!Changed(kEnable, cap, 0, &value, 1)) return;
+    if (on) glEnable(cap);
+    else glDisable(cap);
+}
+
+void GLStateCache::ShadeModel(GLenum mode) {
+    const GLfloat value = GLfloat(mode);
+    if (Changed(kShadeModel, 0, 0, &value, 1)) glShadeModel(mode);
+}
+
+void GLStateCache::LineWidth(GLfloat width) {
+    if (Changed(kLineWidth, 0, 0, &width, 1)) glLineWidth(width);
+}
+
+void GLStateCache::Material(GLenum face, GLenum pname, const GLfloat *params) {
+    if (Changed(kMaterial, face, pname, params, NumParams(pname))) glMaterialfv(face, pname, params);
+}
+
+void GLStateCache::Light(GLenum light, GLenum pname, const GLfloat *params) {
+    if (pname == GL_POSITION || pname == GL_SPOT_DIRECTION) {
+        ++m_issued;
+        glLightfv(light, pname, params);
+        return;
+    }
+    if (Changed(kLight, light, pname, params, NumParams(pname))) glLightfv(light, pname, params);
+}
+
+void GLStateCache::LightModel(GLenum pname, const GLfloat *params) {
+    if (Changed(kLightModel, pname, 0, params, NumParams(pname))) glLightModelfv(pname, params);
+}
+
+void GLStateCache::Projection(const GLfloat *m) {
+    if (!Changed(kProjection, 0, 0, m, 16)) return;
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(m);
+    glMatrixMode(GL_MODELVIEW);
+}
@@ -0,0 +1,52 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include <GL/glew.h>
+#include <map>
+#include <vector>
+#include <utility>
+
+// Shadow copy of the fixed function state set by OpenGLWindow: enable bits, shade model, line width,
+// material, light and projection.  A call only reaches the driver when it changes the state, and every
+// call is counted as issued or skipped for the current frame.
+// State changed behind the cache's back must be restored (glPushAttrib/glPopAttrib) or Invalidate()d.
+class GLStateCache
+{
+public:
+    GLStateCache();
+
+    // Forget everything, e.g. for a new context.  The next call of each kind is issued.
+    void Invalidate();
+
+    // Start counting a new frame; the counts of the finished one stay available through LastFrame*().
+    void BeginFrame();
+    int Issued() const { return m_issued; }
+    int Skipped() const { return m_skipped; }
+    int LastFrameIssued() const { return m_last_issued; }
+    int LastFrameSkipped() const { return m_last_skipped; }
+
+    void Enable(GLenum cap, bool on);
+    void ShadeModel(GLenum mode);
+    void LineWidth(GLfloat width);
+    void Material(GLenum face, GLenum pname, const GLfloat *params);
+    // GL_POSITION and GL_SPOT_DIRECTION are transformed by the modelview matrix at call time, so they
+    // are always issued.
+    void Light(GLenum light, GLenum pname, const GLfloat *params);
+    void LightModel(GLenum pname, const GLfloat *params);
+    // Load the column major matrix `m` as projection.  The matrix mode is left at GL_MODELVIEW.
+    void Projection(const GLfloat *m);
+
+private:
+    enum Kind {kEnable, kShadeModel, kLineWidth, kMaterial, kLight, kLightModel, kProjection};
+    typedef std::pair<int, std::pair<GLenum, GLenum>> Key;
+
+    // Store `n` values under `key` and return true if they differ from the stored ones.
+    bool Changed(Kind kind, GLenum a, GLenum b, const GLfloat *values, int n);
+
+private:
+    std::map<Key, std::vector<GLfloat>> m_state;
+    int m_issued, m_skipped;
+    int m_last_issued, m_last_skipped;
+};
+
+#endif // GLSTATECACHE_H
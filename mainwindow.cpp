@@ -10,7 +10,9 @@
 #include <QCheckBox>
 #include <QComboBox>
 #include <QDoubleSpinBox>
+#include <QSpinBox>
 #include <QStringList>
+#include <QProgressBar>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -48,6 +50,12 @@ void MainWindow::CreateActions() {
     action_open_->setShortcut(QKeySequence::Open);
     action_open_->setStatusTip(tr("Open an existing mesh (Current only m-file is supported)."));
     connect(action_open_, SIGNAL(triggered(bool)), openglwindow_, SLOT(ReadMesh()));
+    action_cancel_ = new QAction(tr("Cancel Loading"), this);
+    action_cancel_->setShortcut(QKeySequence(Qt::Key_Escape));
+    action_cancel_->setStatusTip(tr("Stop loading the mesh, the current mesh is kept."));
+    action_cancel_->setEnabled(false);
+    connect(action_cancel_, SIGNAL(triggered(bool)), openglwindow_, SLOT(CancelLoading()));
+    connect(openglwindow_, SIGNAL(loadStateChanged(bool)), action_cancel_, SLOT(setEnabled(bool)));
     action_exit_ = new QAction(tr("Exit"), this);
     action_exit_->setShortcut(QKeySequence::Quit);
     connect(action_exit_, SIGNAL(triggered(bool)), this, SLOT(close()));
@@ -56,6 +64,7 @@ void MainWindow::CreateActions() {
 void MainWindow::CreateMenus() {
     menu_file_ = menuBar()->addMenu(tr("&File"));
     menu_file_->addAction(action_open_);
+    menu_file_->addAction(action_cancel_);
     menu_file_->addAction(action_exit_);
 }
 
@@ -63,6 +72,13 @@ void MainWindow::CreateStatusBar() {
     label_meshinfo_ = new QLabel();
     statusBar()->addWidget(label_meshinfo_);
     connect(openglwindow_, SIGNAL(operatorInfo(QString)), label_meshinfo_, SLOT(setText(QString)));
+    progress_load_ = new QProgressBar();
+    progress_load_->setRange(0, 100);
+    progress_load_->setMaximumWidth(200);
+    progress_load_->setVisible(false);
+    statusBar()->addPermanentWidget(progress_load_);
+    connect(openglwindow_, SIGNAL(loadProgress(int)), progress_load_, SLOT(setValue(int)));
+    connect(openglwindow_, SIGNAL(loadStateChanged(bool)), progress_load_, SLOT(setVisible(bool)));
 }
 
 void MainWindow::CreateOptionGroup() {
@@ -72,6 +88,9 @@ void MainWindow::CreateOptionGroup() {
     check_edge_ = new QCheckBox(tr("Edge"), this);
     connect(check_edge_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetDrawEdges(bool)));
     check_edge_->setChecked(true);
+    check_boundary_ = new QCheckBox(tr("Boundary"), this);
+    connect(check_boundary_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetDrawBoundary(bool)));
+    check_boundary_->setChecked(false);
     check_face_ = new QCheckBox(tr("Face"), this);
     connect(check_face_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetDrawFaces(bool)));
     check_face_->setChecked(true);
@@ -81,12 +100,24 @@ void MainWindow::CreateOptionGroup() {
     check_aabb_ = new QCheckBox(tr("AABB"), this);
     connect(check_aabb_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetDrawBoundingBox(bool)));
     check_aabb_->setChecked(false);
+    check_hud_ = new QCheckBox(tr("Frame Times"), this);
+    connect(check_hud_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetDrawHud(bool)));
+    check_hud_->setChecked(false);
     check_light_ = new QCheckBox(tr("Lighting"), this);
     connect(check_light_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetDrawLighting(bool)));
     check_light_->setChecked(true);
     check_normalize_ = new QCheckBox(tr("Normalize"), this);
     connect(check_normalize_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetNormalized(bool)));
     check_normalize_->setChecked(false);
+    check_adaptive_ = new QCheckBox(tr("Adaptive Quality"), this);
+    connect(check_adaptive_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetAdaptiveQuality(bool)));
+    check_adaptive_->setChecked(true);
+    check_lods_ = new QCheckBox(tr("Levels of Detail"), this);
+    connect(check_lods_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetUseLods(bool)));
+    check_lods_->setChecked(true);
+    check_culling_ = new QCheckBox(tr("Frustum Culling"), this);
+    connect(check_culling_, SIGNAL(clicked(bool)), openglwindow_, SLOT(SetFrustumCulling(bool)));
+    check_culling_->setChecked(true);
     combobox_projection_ = new QComboBox(this);
     combobox_projection_->addItem("Perspective Projection");
     combobox_projection_->addItem("Orthogonal Projection");
@@ -114,16 +145,27 @@ void MainWindow::CreateOptionGroup() {
     spinbox_light_intensity_->setSingleStep(0.05);
     spinbox_light_intensity_->setValue(1.0);
     connect(spinbox_light_intensity_, SIGNAL(valueChanged(double)), openglwindow_, SLOT(SetLightIntensity(double)));
+    label_idle_timeout_ = new QLabel(tr("Idle Timeout (ms)"), this);
+    spinbox_idle_timeout_ = new QSpinBox(this);
+    spinbox_idle_timeout_->setRange(0, 5000);
+    spinbox_idle_timeout_->setSingleStep(50);
+    spinbox_idle_timeout_->setValue(300);
+    connect(spinbox_idle_timeout_, SIGNAL(valueChanged(int)), openglwindow_, SLOT(SetIdleTimeout(int)));
 
     groupbox_options_ = new QGroupBox(tr("Options"), this);
     QVBoxLayout *options_layout_ = new QVBoxLayout(groupbox_options_);
     options_layout_->addWidget(check_point_);
     options_layout_->addWidget(check_edge_);
+    options_layout_->addWidget(check_boundary_);
     options_layout_->addWidget(check_face_);
     options_layout_->addWidget(check_axes_);
     options_layout_->addWidget(check_aabb_);
+    options_layout_->addWidget(check_hud_);
     options_layout_->addWidget(check_light_);
     options_layout_->addWidget(check_normalize_);
+    options_layout_->addWidget(check_adaptive_);
+    options_layout_->addWidget(check_lods_);
+    options_layout_->addWidget(check_culling_);
     options_layout_->addWidget(combobox_projection_);
     options_layout_->addWidget(combobox_shade_);
 
@@ -133,6 +175,8 @@ void MainWindow::CreateOptionGroup() {
     others_layout_->addWidget(spinbox_roll_speed_);
     others_layout_->addWidget(label_light_intensity_);
     others_layout_->addWidget(spinbox_light_intensity_);
+    others_layout_->addWidget(label_idle_timeout_);
+    others_layout_->addWidget(spinbox_idle_timeout_);
     others_layout_->addWidget(label_material_);
     others_layout_->addWidget(combobox_material_);
 }
@@ -11,6 +11,8 @@ class QGroupBox;
 class QCheckBox;
 class QComboBox;
 class QDoubleSpinBox;
+class QSpinBox;
+class QProgressBar;
 
 namespace Ui {
 class MainWindow;
@@ -37,18 +39,25 @@ private:
     // Menu
     QMenu *menu_file_;
     QAction *action_open_;
+    QAction *action_cancel_;
     QAction *action_exit_;
     QLabel  *label_meshinfo_;
+    QProgressBar *progress_load_;
 
     // Options
     QGroupBox *groupbox_options_;
     QCheckBox *check_point_;
     QCheckBox *check_edge_;
+    QCheckBox *check_boundary_;
     QCheckBox *check_face_;
     QCheckBox *check_axes_;
     QCheckBox *check_aabb_;
+    QCheckBox *check_hud_;
     QCheckBox *check_light_;
     QCheckBox *check_normalize_;
+    QCheckBox *check_adaptive_;
+    QCheckBox *check_lods_;
+    QCheckBox *check_culling_;
     QComboBox *combobox_projection_;
     QComboBox *combobox_shade_;
 
@@ -60,6 +69,8 @@ private:
     QComboBox *combobox_material_;
     QLabel *label_light_intensity_;
     QDoubleSpinBox *spinbox_light_intensity_;
+    QLabel *label_idle_timeout_;
+    QSpinBox *spinbox_idle_timeout_;    // full quality again after this many ms without input
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,175 @@
+#include "common.h"
+#include "meshbuffers.h"
+#include "TriMesh.h"
+#include <vector>
+
+namespace {
+const int kVertexFloats = 6;    // x, y, z, nx, ny, nz
+}
+
+MeshBuffers::MeshBuffers()
+    : m_vertex_buffer(0), m_index_buffer(0), m_edge_buffer(0), m_num_vertices(0), m_num_indices(0),
+      m_num_edge_indices(0), m_num_boundary_indices(0), m_revision(0), m_uploaded(false), m_face_order(),
+      m_order_changed(false)
+{}
+
+void MeshBuffers::Update(TriMesh &mesh) {
+    const bool same_size = m_uploaded && m_num_vertices == GLsizei(mesh.NumVertices()) &&
+                           m_num_indices == GLsizei(3 * mesh.NumFaces());
+    if (same_size && m_revision == mesh.Revision() && !m_order_changed) return;
+    if (m_vertex_buffer == 0) glGenBuffers(1, &m_vertex_buffer);
+    if (m_index_buffer == 0) glGenBuffers(1, &m_index_buffer);
+    if (m_edge_buffer == 0) glGenBuffers(1, &m_edge_buffer);
+    if (!same_size || m_order_changed) UploadIndices(mesh);
+    if (!same_size) UploadEdges(mesh);
+    if (!same_size || m_revision != mesh.Revision()) UploadVertices(mesh, !same_size);
+    m_revision = mesh.Revision();
+    m_uploaded = true;
+}
+
+// Positions and normals are gathered in parallel, then sent in one call.
+void MeshBuffers::UploadVertices(TriMesh &mesh, bool resize) {
+    const size_t num_verts = mesh.NumVertices();
+    std::vector<GLfloat> data(kVertexFloats * num_verts);
+    ParallelFor(0, num_verts, [&](size_t b, size_t e, int) {
+        for (size_t i = b; i < e; ++i) {
+            const HE_vert *v = mesh.GetVertex(i);
+            GLfloat *d = data.data() + kVertexFloats * i;
+            d[0] = v->x;  d[1] = v->y;  d[2] = v->z;
+            d[3] = v->nx; d[4] = v->ny; d[5] = v->nz;
+        }
+    }, MIN<int>(NumThreads(), int(num_verts / 65536) + 1));
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+    if (resize)
+        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.data(), GL_DYNAMIC_DRAW);
+    else
+        glBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(GLfloat), data.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_num_vertices = GLsizei(num_verts);
+}
+
+void MeshBuffers::SetFaceOrder(const std::vector<int> &order) {
+    m_face_order = order;
+    m_order_changed = true;
+}
+
+// Each face starts from e->vert as drawn before, so that flat shading picks the same vertex normal
+// (the last vertex of a triangle).  The corner table starts from e->pair->vert.
+// A face order for another number of faces is ignored.
+void MeshBuffers::UploadIndices(TriMesh &mesh) {
+    const std::vector<int> &tri = mesh.GetTriangles();
+    const bool ordered = m_face_order.size() * 3 == tri.size();
+    std::vector<GLuint> indices(tri.size());
+    for (size_t k = 0; k + 2 < tri.size(); k += 3) {
+        const size_t f = ordered ? 3 * size_t(m_face_order[k / 3]) : k;
+        indices[k] = GLuint(tri[f + 1]);
+        indices[k + 1] = GLuint(tri[f + 2]);
+        indices[k + 2] = GLuint(tri[f]);
+    }
+    m_order_changed = false;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    m_num_indices = GLsizei(indices.size());
+}
+
+// One line per pair of half-edges, taken from the half-edge with the smaller id.  The edges are collected
+// in parallel into per-thread lists, interior and boundary ones apart.
+void MeshBuffers::UploadEdges(TriMesh &mesh) {
+    const size_t num_edges = mesh.NumEdges();
+    const int threads = MIN<int>(NumThreads(), int(num_edges / 65536) + 1);
+    std::vector<std::vector<GLuint>> interior(threads), boundary(threads);
+    auto first = mesh.GetEdgesBegin();
+    ParallelFor(0, num_edges, [&](size_t b, size_t e, int t) {
+        for (size_t i = b; i < e; ++i) {
+            const HE_edge *he = first[i];
+            if (!he->pair || he->id > he->pair->id) continue;
+            std::vector<GLuint> &list = (he->face && he->pair->face) ? interior[t] : boundary[t];
+            list.push_back(GLuint(he->pair->vert->index));
+            list.push_back(GLuint(he->vert->index));
+        }
+    }, threads);
+    std::vector<GLuint> indices;
+    indices.reserve(num_edges);
+    for (const auto &list : interior) indices.insert(indices.end(), list.begin(), list.end());
+    const size_t num_interior = indices.size();
+    for (const auto &list : boundary) indices.insert(indices.end(), list.begin(), list.end());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_edge_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    m_num_edge_indices = GLsizei(indices.size());
+    m_num_boundary_indices = GLsizei(indices.size() - num_interior);
+}
+
+// With `step` > 1 the arrays skip to every `step`-th vertex.
+void MeshBuffers::BindVertices(int step) const {
+    const GLsizei stride = step * kVertexFloats * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(0));
+    glNormalPointer(GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(3 * sizeof(GLfloat)));
+}
+
+void MeshBuffers::UnbindVertices() const {
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffers::DrawPoints(int step) const {
+    if (!m_uploaded) return;
+    assert(step >= 1);
+    BindVertices(step);
+    glDrawArrays(GL_POINTS, 0, (m_num_vertices + step - 1) / step);
+    UnbindVertices();
+}
+
+void MeshBuffers::DrawEdges(bool highlight_boundary) const {
+    if (!m_uploaded) return;
+    BindVertices();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_edge_buffer);
+    const GLsizei num_interior = m_num_edge_indices - m_num_boundary_indices;
+    const GLsizei count = (highlight_boundary && m_num_boundary_indices > 0) ? num_interior : m_num_edge_indices;
+    glDrawElements(GL_LINES, count, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(0));
+    if (count < m_num_edge_indices) {
+        glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_LINE_BIT);
+        glDisable(GL_LIGHTING);
+        glColor3f(1.0f, 0.2f, 0.2f);
+        glLineWidth(3.);
+        glDrawElements(GL_LINES, m_num_boundary_indices, GL_UNSIGNED_INT,
+                       reinterpret_cast<const GLvoid *>(num_interior * sizeof(GLuint)));
+        glPopAttrib();
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    UnbindVertices();
+}
+
+// The ranges go to the driver in one glMultiDrawElements call.
+void MeshBuffers::DrawFaces(const std::vector<std::pair<int, int>> *ranges) const {
+    if (!m_uploaded) return;
+    BindVertices();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+    if (ranges) {
+        std::vector<GLsizei> counts(ranges->size());
+        std::vector<const GLvoid *> offsets(ranges->size());
+        for (size_t i = 0; i < ranges->size(); ++i) {
+            counts[i] = GLsizei(3 * (*ranges)[i].second);
+            offsets[i] = reinterpret_cast<const GLvoid *>(3 * size_t((*ranges)[i].first) * sizeof(GLuint));
+        }
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), GLsizei(counts.size()));
+    } else {
+        glDrawElements(GL_TRIANGLES, m_num_indices, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(0));
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    UnbindVertices();
+}
+
+void MeshBuffers::Release() {
+    if (m_vertex_buffer) glDeleteBuffers(1, &m_vertex_buffer);
+    if (m_index_buffer) glDeleteBuffers(1, &m_index_buffer);
+    if (m_edge_buffer) glDeleteBuffers(1, &m_edge_buffer);
+    m_vertex_buffer = m_index_buffer = m_edge_buffer = 0;
+    m_num_vertices = m_num_indices = m_num_edge_indices = m_num_boundary_indices = 0;
+    m_uploaded = false;
+}
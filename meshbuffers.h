@@ -0,0 +1,65 @@
+#ifndef MESHBUFFERS_H
+#define MESHBUFFERS_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <vector>
+#include <utility>
+
+class TriMesh;
+
+// GPU copy of a mesh: one interleaved vertex buffer (position, normal), one triangle index buffer and one
+// line index buffer with every edge once, drawn with glDrawElements through the fixed function pipeline,
+// so materials and lighting apply as before.
+// The buffers are uploaded by Update() only when the mesh has changed since the last upload.
+// Triangles can be stored in another order, e.g. the leaf order of a BVH, so that parts of the mesh are
+// contiguous ranges of the index buffer.
+// All methods except Invalidate() need the GL context to be current.
+class MeshBuffers
+{
+public:
+    MeshBuffers();
+    ~MeshBuffers() {}   // GL objects are freed by Release(), while the context is alive
+
+    // Forget the uploaded mesh, e.g. when another mesh is displayed.  The next Update() uploads all.
+    void Invalidate() { m_uploaded = false; }
+
+    // Upload `mesh` if it is not the uploaded one or if its Revision() has changed.
+    // Only the vertex buffer is uploaded again when the topology stays the same.
+    void Update(TriMesh &mesh);
+
+    // Store triangle `order[k]` of the face list at position k of the index buffer, or all in the order of
+    // the face list if `order` is empty.  Taken by the next Update().
+    void SetFaceOrder(const std::vector<int> &order);
+
+    // Every `step`-th vertex, starting from the first.
+    void DrawPoints(int step = 1) const;
+    // All edges in one batch, or the boundary edges on top in their own color and width if highlighted.
+    void DrawEdges(bool highlight_boundary = false) const;
+    // All faces, or the ranges (first, count) of positions in the face order.
+    void DrawFaces(const std::vector<std::pair<int, int>> *ranges = nullptr) const;
+
+    void Release();
+
+private:
+    void BindVertices(int step = 1) const;
+    void UnbindVertices() const;
+    void UploadVertices(TriMesh &mesh, bool resize);
+    void UploadIndices(TriMesh &mesh);
+    void UploadEdges(TriMesh &mesh);
+
+private:
+    GLuint m_vertex_buffer;
+    GLuint m_index_buffer;
+    GLuint m_edge_buffer;       // interior edges, then boundary edges, two indices each
+    GLsizei m_num_vertices;
+    GLsizei m_num_indices;
+    GLsizei m_num_edge_indices;
+    GLsizei m_num_boundary_indices;     // at the end of m_edge_buffer
+    size_t m_revision;     // of the uploaded mesh
+    bool m_uploaded;
+    std::vector<int> m_face_order;
+    bool m_order_changed;
+};
+
+#endif // MESHBUFFERS_H
@@ -0,0 +1,58 @@
+#include "common.h"
+#include "meshloader.h"
+#include "TriMesh.h"
+#include "MParser.h"
+#include "MeshCache.h"
+#include "Simplify.h"
+#include "BVH.h"
+#include <chrono>
+
+MeshLoader::MeshLoader(QObject *parent)
+    : QObject(parent), m_active_request(0)
+{
+    qRegisterMetaType<TriMeshPtr>("TriMeshPtr");
+    qRegisterMetaType<TriMeshList>("TriMeshList");
+    qRegisterMetaType<BVHPtr>("BVHPtr");
+}
+
+void MeshLoader::Load(QString filename, int request) {
+    if (m_active_request != request) return; // superseded while waiting in the queue
+    std::atomic<int> last_percent(-1);
+    ProgressCallback report = [this, request, &last_percent](float fraction) {
+        int percent = static_cast<int>(fraction * 100.f);
+        if (last_percent.exchange(percent) != percent) {
+            emit(progress(percent, request));
+        }
+        return m_active_request == request;
+    };
+    TriMeshPtr mesh = LoadMesh(filename.toStdString(), report);
+    if (m_active_request != request) return; // canceled, the result is of no interest
+    if (!mesh) {
+        emit(failed(QString("Cannot read mesh from file."), request));
+        return;
+    }
+    emit(loaded(mesh, filename, request));
+    BuildBvhAndLods(*mesh, request);
+    emit(released(request));
+}
+
+// Runs while the mesh is on screen.  It is only read, the window leaves it unchanged until released.
+void MeshLoader::BuildBvhAndLods(TriMesh &mesh, int request) {
+    ProgressCallback keep_going = [this, request](float) { return m_active_request == request; };
+    BVHPtr bvh = std::make_shared<BVH>(mesh, 0, keep_going);
+    if (m_active_request != request || bvh->IsCanceled()) return;
+    const BVH::Stats &stats = bvh->GetStats();
+    printf("MeshLoader.BuildBvhAndLods: Built a BVH of %d nodes (%d leaves, depth %d, SAH cost %.1f) "
+           "in %.2fs, %.1f bytes per face.\n", stats.nodes, stats.leaves, stats.depth, stats.sah_cost, stats.build_seconds,
+           double(stats.bytes) / MAX<double>(1., double(mesh.NumFaces())));
+    emit(bvhReady(bvh, request));
+
+    if (mesh.NumFaces() < kMinLodFaces) return;
+    static const std::vector<float> fractions = {0.5f, 0.25f, 0.1f, 0.02f};
+    const auto start = std::chrono::steady_clock::now();   // wall time, as the BVH reports it
+    TriMeshList lods = BuildLodChain(mesh, fractions, keep_going);
+    if (m_active_request != request || lods.empty()) return;
+    printf("MeshLoader.BuildBvhAndLods: Built %d levels of detail in %.2fs.\n", int(lods.size()),
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    emit(lodsReady(lods, request));
+}
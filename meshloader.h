@@ -0,0 +1,56 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QMetaType>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+class TriMesh;
+class BVH;
+typedef std::shared_ptr<TriMesh> TriMeshPtr;
+typedef std::vector<TriMeshPtr> TriMeshList;
+typedef std::shared_ptr<BVH> BVHPtr;
+Q_DECLARE_METATYPE(TriMeshPtr)
+Q_DECLARE_METATYPE(TriMeshList)
+Q_DECLARE_METATYPE(BVHPtr)
+
+// Worker object that loads meshes on its own thread.
+// Every load request carries an id.  Only the request set by SetActiveRequest is allowed to run;
+// making another request active (or 0 for none) cancels the one in flight.
+// Once a mesh is loaded, a BVH over its faces is built on the same thread and sent by bvhReady.  Then, for a
+// mesh of at least kMinLodFaces faces, its levels of detail are built (see BuildLodChain) and sent by
+// lodsReady.  Both are part of the request and canceled with it.
+// The mesh sent by loaded is read here until released is sent for the request: the receiver may draw it
+// meanwhile, but must not modify it.
+class MeshLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum {kMinLodFaces = 100000};
+
+    explicit MeshLoader(QObject *parent = 0);
+
+    void SetActiveRequest(int request) { m_active_request = request; } // thread-safe
+
+public slots:
+    void Load(QString filename, int request);
+
+signals:
+    void progress(int percent, int request);
+    void loaded(TriMeshPtr mesh, QString filename, int request);
+    void bvhReady(BVHPtr bvh, int request);
+    void lodsReady(TriMeshList lods, int request);     // finest first
+    void released(int request);     // the mesh of the request is no longer read here
+    void failed(QString reason, int request);
+
+private:
+    void BuildBvhAndLods(TriMesh &mesh, int request);
+
+    std::atomic<int> m_active_request;
+};
+
+#endif // MESHLOADER_H
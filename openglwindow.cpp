@@ -2,11 +2,16 @@
 #include "GL/glew.h"
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include "openglwindow.h"
 #include "TriMesh.h"
-#include "MParser.h"
+#include "BVH.h"
+#include "meshloader.h"
 #include "arcball.h"
 #include <QFileDialog>
+#include <QStringList>
+#include <QGuiApplication>
+#include <QScreen>
 #include <QString>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -15,6 +20,12 @@
 #include <QKeyEvent>
 #include <QWheelEvent>
 
+namespace {
+const float kFov = 45.0;    // vertical field of view of the perspective projection, in degrees
+// Triangles per pixel covered by the mesh at which a level of detail is fine enough, see SelectLod.
+const float kLodFacesPerPixel = 1.0;
+}
+
 // http://devernay.free.fr/cours/opengl/materials.html
 std::unordered_map<std::string, Material> RegisterMaterials() {
     auto mat = std::unordered_map<std::string, Material>{};
@@ -34,17 +45,58 @@ std::unordered_map<std::string, Material> RegisterMaterials() {
 }
 
 OpenGLWindow::OpenGLWindow(QWidget *parent)
-    : QGLWidget(parent), m_mesh(nullptr), m_camera(),
-      m_draw_axes(true), m_draw_points(true), m_draw_edges(true),
+    : QGLWidget(parent), m_mesh(nullptr), m_buffers(), m_bvh(), m_frustum_culling(true), m_visible_faces(),
+      m_num_visible_faces(-1), m_picked{-1, -1, {-1, -1}, {0.f, 0.f, 0.f}},
+      m_lods(), m_lod_buffers(), m_use_lods(true), m_lod(-1),
+      m_axes(), m_camera(),
+      m_draw_axes(true), m_draw_points(true), m_draw_edges(true), m_draw_boundary(false),
       m_draw_faces(true), m_draw_texture(true), m_arcball(this->width(), this->height()),
       m_draw_bounding_box(false), m_lighting(true),
-      m_bounding_box{0.f, 0.f, 0.f, 0.f, 0.f, 0.f}, m_projection(Persp), m_shade(Smooth),
+      m_bounding_box{0.f, 0.f, 0.f, 0.f, 0.f, 0.f}, m_projection(Persp), m_projection_matrix(1.f), m_shade(Smooth),
       m_roll_speed(0.001), m_normalize_size(false), m_materials(RegisterMaterials()),
-      m_material_name("emerald"), m_light_intensity(1.0)
+      m_material_name("emerald"), m_light_intensity(1.0),
+      m_gl_state(), m_print_gl_stats(getenv("MESHVIEWER_GL_STATS") != nullptr),
+      m_profiler(), m_draw_hud(false),
+      m_repaint_timer(), m_last_frame(), m_frame_interval_ms(16),
+      m_quality(), m_idle_timer(),
+      m_loader(nullptr), m_load_request(0), m_loading(false), m_mesh_request(0), m_mesh_shared(false)
 {
+    m_loader = new MeshLoader;  // no parent since it is moved to the loader thread
+    m_loader->moveToThread(&m_loader_thread);
+    connect(&m_loader_thread, SIGNAL(finished()), m_loader, SLOT(deleteLater()));
+    connect(this, SIGNAL(requestLoad(QString,int)), m_loader, SLOT(Load(QString,int)));
+    connect(m_loader, SIGNAL(progress(int,int)), this, SLOT(OnLoadProgress(int,int)));
+    connect(m_loader, SIGNAL(loaded(TriMeshPtr,QString,int)), this, SLOT(OnMeshLoaded(TriMeshPtr,QString,int)));
+    connect(m_loader, SIGNAL(bvhReady(BVHPtr,int)), this, SLOT(OnBvhReady(BVHPtr,int)));
+    connect(m_loader, SIGNAL(lodsReady(TriMeshList,int)), this, SLOT(OnLodsReady(TriMeshList,int)));
+    connect(m_loader, SIGNAL(released(int)), this, SLOT(OnMeshReleased(int)));
+    connect(m_loader, SIGNAL(failed(QString,int)), this, SLOT(OnLoadFailed(QString,int)));
+    m_loader_thread.start();
+    qreal refresh_rate = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60.;
+    if (refresh_rate > 0.) m_frame_interval_ms = MAX(1, int(1000. / refresh_rate));
+    m_repaint_timer.setSingleShot(true);
+    m_repaint_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_repaint_timer, SIGNAL(timeout()), this, SLOT(updateGL()));
+    const char *target_fps = getenv("MESHVIEWER_TARGET_FPS");
+    if (target_fps != nullptr && atof(target_fps) > 0.) m_quality.SetTargetMs(1000. / atof(target_fps));
+    else m_quality.SetTargetMs(m_frame_interval_ms);
+    m_idle_timer.setSingleShot(true);
+    m_idle_timer.setInterval(300);
+    connect(&m_idle_timer, SIGNAL(timeout()), this, SLOT(OnIdle()));
+    const char *frame_log = getenv("MESHVIEWER_FRAME_LOG");
+    if (frame_log != nullptr) m_profiler.OpenLog(frame_log);
 }
 
-OpenGLWindow::~OpenGLWindow() {}
+OpenGLWindow::~OpenGLWindow() {
+    m_loader->SetActiveRequest(0);  // stop a load in flight
+    m_loader_thread.quit();
+    m_loader_thread.wait();
+    makeCurrent();
+    m_buffers.Release();
+    for (MeshBuffers &buffers : m_lod_buffers) buffers.Release();
+    m_axes.Release();
+    m_profiler.Release();
+}
 
 void OpenGLWindow::initializeGL() {
     glewExperimental = true;
@@ -54,6 +106,7 @@ void OpenGLWindow::initializeGL() {
         exit(1);
     }
     glClearColor(0.3f, 0.3f, 0.3f, 0.0);
+    m_gl_state.Invalidate();    // a new context
 //    glShadeModel(GL_SMOOTH);
     Shade();
 
@@ -66,6 +119,7 @@ void OpenGLWindow::initializeGL() {
     glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
     glEnable(GL_DEPTH_TEST);
     glClearDepth(1);
+    m_profiler.Initialize();
 
     SetLight();
 }
@@ -89,16 +143,27 @@ void OpenGLWindow::resizeGL(int w, int h) {
 }
 
 void OpenGLWindow::paintGL() {
+    m_last_frame.start();
+    m_repaint_timer.stop();     // this frame shows whatever was requested so far
+    m_profiler.BeginFrame();
+    m_gl_state.BeginFrame();
 //    glShadeModel(GL_SMOOTH);
     Shade();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (m_lighting) {
-        SetLight();
-    } else {
-        glDisable(GL_LIGHTING);
-        glDisable(GL_LIGHT0);
+    {
+        FrameProfiler::Scope scope(m_profiler, FrameProfiler::Update);
+        // pick up vertices moved since the last frame, only their neighborhood is recomputed
+        if (CanEditMesh() && m_mesh->NumDirtyVertices() > 0) {
+            m_mesh->Refresh();
+            this->ComputeBoundingBox();
+            if (m_bvh) m_bvh->Refit(*m_mesh);
+            m_lods.clear();     // no longer match the mesh
+        }
+        m_lod = SelectLod();
+        if (m_mesh) DrawnBuffers().Update(DrawnMesh());     // no-op unless the mesh has changed
     }
+
     // MVP, projection should come first.
     Project();
 
@@ -108,9 +173,21 @@ void OpenGLWindow::paintGL() {
 
     glPushMatrix();
     glMultMatrixf(glm::value_ptr(m_arcball.GetMatrix()));
+    // the light position is taken through LookAt and arcball, so the light turns with the model
+    if (m_lighting) {
+        SetLight();
+    } else {
+        m_gl_state.Enable(GL_LIGHTING, false);
+        m_gl_state.Enable(GL_LIGHT0, false);
+    }
     Render();
     glPopMatrix();
+    m_profiler.EndFrame();
+    AdaptQuality();
+    DrawHud(m_draw_hud);
 
+    if (m_print_gl_stats)
+        printf("OpenGLWindow.paintGL: %d state calls issued, %d skipped.\n", m_gl_state.Issued(), m_gl_state.Skipped());
 }
 
 // events
@@ -125,22 +202,25 @@ void OpenGLWindow::mousePressEvent(QMouseEvent *e) {
         m_camera.SetCurrentPosition(e->pos().x(), e->pos().y());
         break;
     case Qt::RightButton:
+        Pick(e->pos().x(), e->pos().y());
         break;
     default:
         break;
     }
-    updateGL();
+    RequestRepaint();
 }
 void OpenGLWindow::mouseMoveEvent(QMouseEvent *e) {
     // Note that the returned value is always Qt::NoButton for mouse move events.
     switch (e->buttons()) { // This should be BUTTONS!
     case Qt::LeftButton:
         m_arcball.MouseMove(e->pos().x(), e->pos().y());
+        Interact();
         break;
     case Qt::MidButton:
 //        printf("Mouse MidButton is moved. Current position: %d %d\n", e->pos().x(), e->pos().y());
         m_camera.CameraMove(e->pos().x(), e->pos().y(), this->width(), this->height());
         m_camera.SetCurrentPosition(e->pos().x(), e->pos().y());
+        Interact();
         break;
     case Qt::RightButton:
         break;
@@ -148,7 +228,7 @@ void OpenGLWindow::mouseMoveEvent(QMouseEvent *e) {
         printf("No such button!\n");
         break;
     }
-    updateGL();
+    RequestRepaint();
 }
 void OpenGLWindow::mouseReleaseEvent(QMouseEvent *e) {
     switch (e->button()) {
@@ -162,13 +242,14 @@ void OpenGLWindow::mouseReleaseEvent(QMouseEvent *e) {
     default:
         break;
     }
-    updateGL();
+    RequestRepaint();
 }
 
 void OpenGLWindow::wheelEvent(QWheelEvent *e) {
     m_camera.distance += e->delta()*m_roll_speed;
     m_camera.distance = m_camera.distance > 0 ? m_camera.distance : 0;
-    updateGL();
+    Interact();
+    RequestRepaint();
 }
 
 //void OpenGLWindow::keyPressEvent(QKeyEvent *e) {}
@@ -176,123 +257,194 @@ void OpenGLWindow::wheelEvent(QWheelEvent *e) {
 
 // public slots:
 
+// Input only updates the camera and options and asks for a frame.  The frame is drawn one refresh
+// interval after the previous one, or right away if that has already passed.
+void OpenGLWindow::RequestRepaint() {
+    if (m_repaint_timer.isActive()) return;     // the pending frame will pick up the latest state
+    qint64 since_last = m_last_frame.isValid() ? m_last_frame.elapsed() : qint64(m_frame_interval_ms);
+    m_repaint_timer.start(int(MAX<qint64>(0, m_frame_interval_ms - since_last)));
+}
+
 
+// The mesh is read on the loader thread, the current mesh stays on screen until the new one is ready.
 void OpenGLWindow::ReadMesh() {
     QString filename = QFileDialog::getOpenFileName(this, tr("Read m-file"), ".", tr("M-File (*.m)"));
     if (filename.isEmpty()) {
         emit(operatorInfo(QString("Cannot open mesh file.")));
         return;
     }
-//    MParser parser{};
-//    m_mesh = parser.ReadMFile(filename.toStdString());
-    m_mesh = ReadMFile(filename.toStdString());
-    if (!m_mesh) {
-        emit(operatorInfo(QString("Cannot read mesh from file.")));
-        return;
-    }
+    int request = ++m_load_request;
+    m_loader->SetActiveRequest(request);    // this also cancels a previous load in flight
+    m_loading = true;
+    emit(loadStateChanged(true));
+    emit(loadProgress(0));
+    emit(operatorInfo(QString("Loading ")+filename));
+    emit(requestLoad(filename, request));
+}
+
+void OpenGLWindow::CancelLoading() {
+    if (!m_loading) return;
+    m_loader->SetActiveRequest(0);
+    ++m_load_request;   // drop whatever the canceled request still reports
+    m_loading = false;
+    emit(loadStateChanged(false));
+    emit(operatorInfo(QString("Loading canceled.")));
+}
+
+void OpenGLWindow::OnLoadProgress(int percent, int request) {
+    if (request != m_load_request) return;
+    emit(loadProgress(percent));
+}
+
+void OpenGLWindow::OnMeshLoaded(TriMeshPtr mesh, QString filename, int request) {
+    if (request != m_load_request) return;
+    m_loading = false;
+    m_mesh = mesh;  // swap in the completely built mesh
+    m_mesh_request = request;
+    m_mesh_shared = true;   // until the loader has built the BVH and levels of detail from it
+    m_buffers.Invalidate();
+    m_buffers.SetFaceOrder(std::vector<int>());
+    m_bvh.reset();      // the new one follows
+    m_picked.face = -1;
+    m_lods.clear();     // the new ones follow, if the mesh is large enough
+    emit(loadStateChanged(false));
     emit(operatorInfo(QString("Read Mesh from")+filename));
     this->ComputeBoundingBox();
     this->PrintMeshInfo(filename);
-    updateGL();
+    RequestRepaint();
+}
+
+void OpenGLWindow::OnLoadFailed(QString reason, int request) {
+    if (request != m_load_request) return;
+    m_loading = false;
+    emit(loadStateChanged(false));
+    emit(operatorInfo(reason));
+}
+
+// The triangles are uploaded again in the order of the BVH with the next frame.
+void OpenGLWindow::OnBvhReady(BVHPtr bvh, int request) {
+    if (request != m_load_request) return;
+    m_bvh = bvh;
+    m_buffers.SetFaceOrder(m_bvh->Faces());
+    RequestRepaint();
+}
+
+void OpenGLWindow::OnLodsReady(TriMeshList lods, int request) {
+    if (request != m_load_request) return;
+    m_lods = lods;
+    if (m_lod_buffers.size() < m_lods.size()) m_lod_buffers.resize(m_lods.size());
+    for (MeshBuffers &buffers : m_lod_buffers) buffers.Invalidate();
+    QString faces;
+    for (const TriMeshPtr &lod : m_lods) faces += QString(" %1").arg(lod->NumFaces());
+    emit(operatorInfo(QString("Levels of detail with") + faces + QString(" faces")));
+    RequestRepaint();
 }
 
+// The loader is done with m_mesh, vertices moved meanwhile are refreshed with the next frame.
+void OpenGLWindow::OnMeshReleased(int request) {
+    if (request != m_mesh_request) return;
+    m_mesh_shared = false;
+    if (m_mesh && m_mesh->NumDirtyVertices() > 0) RequestRepaint();
+}
+
+// No input for the idle timeout, draw the view at full quality again.
+void OpenGLWindow::OnIdle() {
+    m_quality.EndInteraction();
+    RequestRepaint();
+}
+
+// Every stage is timed by m_profiler, see FrameProfiler.
+// While the view is dragged, m_quality may drop the wireframe and replace the mesh by a point subset.
 void OpenGLWindow::Render() {
-    DrawAxes(m_draw_axes);
+    const int step = m_quality.PointStep();
+    m_num_visible_faces = -1;
+    {
+        FrameProfiler::Scope scope(m_profiler, FrameProfiler::Axes);
+        DrawAxes(m_draw_axes);
+    }
     NormalizeSize(m_normalize_size);
-    DrawPoints(m_draw_points);
-    DrawEdges(m_draw_edges);
-    DrawFaces(m_draw_faces);
-    DrawBoundingBox(m_draw_bounding_box);
+    {
+        FrameProfiler::Scope scope(m_profiler, FrameProfiler::Points);
+        if (step > 1) DrawPointSubset(m_draw_points || m_draw_edges || m_draw_faces, step);
+        else DrawPoints(m_draw_points);
+    }
+    {
+        FrameProfiler::Scope scope(m_profiler, FrameProfiler::Edges);
+        DrawEdges(m_draw_edges && m_quality.DrawsWireframe());
+    }
+    {
+        FrameProfiler::Scope scope(m_profiler, FrameProfiler::Faces);
+        DrawFaces(m_draw_faces && step == 1);
+        DrawPicked(true);
+    }
+    {
+        FrameProfiler::Scope scope(m_profiler, FrameProfiler::BoundingBox);
+        DrawBoundingBox(m_draw_bounding_box);
+    }
 //    DrawTexture(m_draw_texture);
 }
 
+// The light position is transformed by the current modelview matrix, so it is sent every time.
+// The rest only reaches GL when it changes, see GLStateCache.
 void OpenGLWindow::SetLight() {
-    static std::string mat_name;
-    static Material material;
     static GLfloat light_position[] = {0.0, 5.0, 0.0, 1.0};
-    static GLfloat white_light[] = {1.0, 1.0, 1.0, 1.0};
-    if (mat_name != m_material_name) {
-        auto it = m_materials.find(m_material_name);
-        assert(it != m_materials.end());
-        mat_name = it->first;
-        material = it->second;
+    auto it = m_materials.find(m_material_name);
+    assert(it != m_materials.end());
+    const Material &material = it->second;
+    const GLfloat shininess = material.Shininess*128.;
+    const GLfloat white_light[] = {m_light_intensity, m_light_intensity, m_light_intensity, 1.0};
+    m_gl_state.Material(GL_FRONT, GL_AMBIENT, material.Ambient);
+    m_gl_state.Material(GL_FRONT, GL_DIFFUSE, material.Diffuse);
+    m_gl_state.Material(GL_FRONT, GL_SPECULAR, material.Specular);
+    m_gl_state.Material(GL_FRONT, GL_SHININESS, &shininess);
+    m_gl_state.Light(GL_LIGHT0, GL_POSITION, light_position);
+    m_gl_state.Light(GL_LIGHT0, GL_DIFFUSE, white_light);
+    m_gl_state.Light(GL_LIGHT0, GL_SPECULAR, white_light);
+    m_gl_state.LightModel(GL_LIGHT_MODEL_AMBIENT, material.ModelAmbient);
+    m_gl_state.Enable(GL_LIGHT0, true);
+    m_gl_state.Enable(GL_NORMALIZE, true);     // This is important!
+    m_gl_state.Enable(GL_LIGHTING, true);
+}
+
+// Three axes with a cone at their tips, and the ground grid.
+void OpenGLWindow::BuildAxes() {
+    const Cone cone(0.4, 0.1, 18);
+    const glm::mat4 identity(1.f);
+    const glm::mat4 place[3] = {
+        glm::rotate(glm::translate(identity, glm::vec3(4.7f, 0.f, 0.f)), glm::radians(90.f), glm::vec3(0.f, 1.f, 0.f)),
+        glm::rotate(glm::translate(identity, glm::vec3(0.f, 4.7f, 0.f)), glm::radians(-90.f), glm::vec3(1.f, 0.f, 0.f)),
+        glm::translate(identity, glm::vec3(0.f, 0.f, 4.7f))
+    };
+    const glm::vec3 color[3] = {glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f)};
+    m_axes.Begin(GL_LINES, 3.f);
+    for (int k = 0; k < 3; ++k) {
+        glm::vec3 tip(0.f);
+        tip[k] = 4.7f;
+        m_axes.Add(0.f, 0.f, 0.f, color[k].r, color[k].g, color[k].b);
+        m_axes.Add(tip.x, tip.y, tip.z, color[k].r, color[k].g, color[k].b);
+    }
+    m_axes.Begin(GL_TRIANGLES);
+    for (int k = 0; k < 3; ++k) {
+        std::vector<glm::vec3> triangles;
+        cone.Triangulate(place[k], triangles);
+        for (const glm::vec3 &p : triangles) m_axes.Add(p.x, p.y, p.z, color[k].r, color[k].g, color[k].b);
     }
-    white_light[0] = white_light[1] = white_light[2] = m_light_intensity;
-    glMaterialfv(GL_FRONT, GL_AMBIENT, material.Ambient);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, material.Diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, material.Specular);
-    glMaterialf(GL_FRONT, GL_SHININESS, material.Shininess*128.);
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, white_light);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, white_light);
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, material.ModelAmbient);
-    glEnable(GL_LIGHT0);
-    glEnable(GL_NORMALIZE);     // This is important!
-    glEnable(GL_LIGHTING);
+    // ground
+    m_axes.Begin(GL_LINES, 1.f);
+    for (int i = 0; i <= 20; ++i) {
+        m_axes.Add(-2.f+0.2f*i, 0.f, -2.f, 0.8f, 0.8f, 0.8f);
+        m_axes.Add(-2.f+0.2f*i, 0.f, 2.0f, 0.8f, 0.8f, 0.8f);
+        m_axes.Add(-2.f, 0.f, -2.f+0.2f*i, 0.8f, 0.8f, 0.8f);
+        m_axes.Add(2.f, 0.f, -2.f+0.2f*i, 0.8f, 0.8f, 0.8f);
+    }
+    m_axes.Upload();
 }
 
 void OpenGLWindow::DrawAxes(bool bv) {
     if (bv) {
-        if (m_lighting) {
-            glDisable(GL_LIGHTING);
-            glDisable(GL_LIGHT0);
-        }
-        glLineWidth(3.);
-        static Cone cx(0.4, 0.1, 18);
-        static Cone cy(0.4, 0.1, 18);
-        static Cone cz(0.4, 0.1, 18);
-        // x-axis
-        glColor3f(1.0f, 0.0f, 0.0f);
-        glBegin(GL_LINES);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(4.7f, 0.0f, 0.0f);
-        glEnd();
-        glPushMatrix(); // cone-x
-        glTranslatef(4.7, 0.0, 0.0);
-        glRotatef(90.0, 0.0, 1.0, 0.0);
-        cx.Draw();
-        glPopMatrix();
-
-        // y-axis
-        glColor3f(0.0f, 1.0f, 0.0f);
-        glBegin(GL_LINES);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(0.0f, 4.7f, 0.0f);
-        glEnd();
-        glPushMatrix(); // cone-y
-        glTranslatef(0.0, 4.7, 0.0);
-        glRotatef(-90.0, 1.0, 0.0, 0.0);
-        cy.Draw();
-        glPopMatrix();
-
-
-        // z-axis
-        glColor3f(0.0f, 0.0f, 1.0f);
-        glBegin(GL_LINES);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(0.0f, 0.0f, 4.7f);
-        glEnd();
-        glPushMatrix(); // cone-z
-        glTranslatef(0.0, 0.0, 4.7);
-        cz.Draw();
-        glPopMatrix();
-        glLineWidth(1.);
-
-        // ground
-        glColor3f(0.8f, 0.8f, 0.8f);
-        glBegin(GL_LINES);
-        for (int i = 0; i <= 20; ++i) {
-            glVertex3f(-2.f+0.2f*i, 0.f, -2.f);
-            glVertex3f(-2.f+0.2*i, 0.f, 2.0f);
-            glVertex3f(-2.f, 0.f, -2.f+0.2f*i);
-            glVertex3f(2.f, 0.f, -2.f+0.2f*i);
-        }
-        glEnd();
-
+        if (!m_axes.IsUploaded()) BuildAxes();
+        m_axes.Draw();
         glColor3f(1.0f, 1.0f, 1.0f);
-        if (m_lighting) {
-            SetLight();
-        }
     }
 }
 
@@ -302,58 +454,37 @@ void OpenGLWindow::DrawTexture(bool bv) {
 
 void OpenGLWindow::DrawPoints(bool bv) {
     if (bv && m_mesh) {
-        glBegin(GL_POINTS);
-        for (auto vit = m_mesh->GetVerticesBegin(); vit != m_mesh->GetVerticesEnd(); ++vit) {
-            glNormal3f((*vit)->nx, (*vit)->ny, (*vit)->nz);
-            glVertex3f((*vit)->x, (*vit)->y, (*vit)->z);
-        }
-        glEnd();
+        DrawnBuffers().DrawPoints();
+    }
+}
+
+// Each point stands in for `step` vertices, so it is drawn larger.
+void OpenGLWindow::DrawPointSubset(bool bv, int step) {
+    if (bv && m_mesh) {
+        glPushAttrib(GL_POINT_BIT);
+        glPointSize(MIN(1.f + sqrtf(float(step)), 6.f));
+        DrawnBuffers().DrawPoints(step);
+        glPopAttrib();
     }
 }
 
 void OpenGLWindow::DrawEdges(bool bv) {
     if (bv && m_mesh) {
-        // We iterate over all faces and draw edges by GL_LINE_LOOP
-        for (auto fit = m_mesh->GetFacesBegin(); fit != m_mesh->GetFacesEnd(); ++fit) {
-            HE_edge *e = (*fit)->edge;
-            HE_vert *v1 = e->vert;
-            HE_vert *v2 = e->next->vert;
-            HE_vert *v3 = e->prev->vert;
-            glBegin(GL_LINE_LOOP);
-            glNormal3f(v1->nx, v1->ny, v1->nz);
-            glVertex3f(v1->x, v1->y, v1->z);
-            glNormal3f(v2->nx, v2->ny, v2->nz);
-            glVertex3f(v2->x, v2->y, v2->z);
-            glNormal3f(v3->nx, v3->ny, v3->nz);
-            glVertex3f(v3->x, v3->y, v3->z);
-            glEnd();
-        }
+        DrawnBuffers().DrawEdges(m_draw_boundary);
     }
 }
 
 void OpenGLWindow::DrawFaces(bool bv) {
     if (bv && m_mesh) {
-        glBegin(GL_TRIANGLES);
-        for (auto fit = m_mesh->GetFacesBegin(); fit != m_mesh->GetFacesEnd(); ++fit) {
-            HE_edge *e = (*fit)->edge;
-            HE_vert *v1 = e->vert;
-            HE_vert *v2 = e->next->vert;
-            HE_vert *v3 = e->prev->vert;
-            glNormal3f(v1->nx, v1->ny, v1->nz);
-            glVertex3f(v1->x, v1->y, v1->z);
-            glNormal3f(v2->nx, v2->ny, v2->nz);
-            glVertex3f(v2->x, v2->y, v2->z);
-            glNormal3f(v3->nx, v3->ny, v3->nz);
-            glVertex3f(v3->x, v3->y, v3->z);
-        }
-        glEnd();
+        if (CullFaces()) DrawnBuffers().DrawFaces(&m_visible_faces);
+        else DrawnBuffers().DrawFaces();
     }
 }
 
 void OpenGLWindow::DrawBoundingBox(bool bv) {
     if (bv && m_mesh) {
         glColor3f(1.0f, 1.0f, 1.0f);
-        glLineWidth(3.);
+        m_gl_state.LineWidth(3.);
         glBegin(GL_LINES);
         // zmin->zmax
         glVertex3f(m_bounding_box.xmin, m_bounding_box.ymin, m_bounding_box.zmin);
@@ -395,19 +526,207 @@ void OpenGLWindow::DrawBoundingBox(bool bv) {
         glVertex3f(m_bounding_box.xmax, m_bounding_box.ymax, m_bounding_box.zmax);
 
         glEnd();
-        glLineWidth(1.);
+        m_gl_state.LineWidth(1.);
+    }
+}
+
+// Times of the last frame whose GPU results are in, drawn over the scene in window coordinates.
+// renderText saves and restores the GL state it touches.
+void OpenGLWindow::DrawHud(bool bv) {
+    if (bv) {
+        QStringList lines;
+        lines << QString("frame %1: %2 ms CPU").arg(m_profiler.Frame()).arg(m_profiler.FrameCpuMs(), 0, 'f', 2);
+        for (int s = 0; s < FrameProfiler::kNumStages; ++s) {
+            QString line = QString("%1: %2 ms CPU").arg(FrameProfiler::StageName(s), -6)
+                                                    .arg(m_profiler.CpuMs(s), 0, 'f', 2);
+            if (m_profiler.HasGpuTimer()) line += QString(", %1 ms GPU").arg(m_profiler.GpuMs(s), 0, 'f', 2);
+            lines << line;
+        }
+        lines << QString("GL state: %1 issued, %2 skipped").arg(m_gl_state.LastFrameIssued())
+                                                          .arg(m_gl_state.LastFrameSkipped());
+        if (m_mesh)
+            lines << QString("%1: %2 faces").arg(m_lod < 0 ? QString("full mesh") : QString("level of detail %1").arg(m_lod))
+                                            .arg(DrawnMesh().NumFaces());
+        if (m_num_visible_faces >= 0)
+            lines << QString("frustum culling: %1 faces in %2 ranges").arg(m_num_visible_faces)
+                                                                     .arg(m_visible_faces.size());
+        if (m_quality.Level() == 1)
+            lines << QString("detail level 1: no wireframe");
+        else if (m_quality.Level() > 1)
+            lines << QString("detail level %1: 1 in %2 vertices").arg(m_quality.Level()).arg(m_quality.PointStep());
+        glColor3f(1.0f, 1.0f, 0.0f);
+        for (int i = 0; i < lines.size(); ++i) renderText(10, 20 + 15*i, lines[i]);
+        glColor3f(1.0f, 1.0f, 1.0f);
     }
 }
 
+// Called by input that moves the view.  Reduced detail is kept until the input stops.
+void OpenGLWindow::Interact() {
+    if (!m_quality.IsInteractive()) m_quality.BeginInteraction(m_profiler.CurrentFrame() + 1);
+    m_idle_timer.start();
+}
+
+// The cost of a frame is its CPU time, or its GPU time if that is longer.
+void OpenGLWindow::AdaptQuality() {
+    const double frame_ms = MAX(m_profiler.FrameCpuMs(), m_profiler.FrameGpuMs());
+    m_quality.Adapt(m_profiler.Frame(), frame_ms, m_profiler.CurrentFrame() + 1);
+}
+
+// The coarsest level of detail with at least kLodFacesPerPixel faces per pixel of the bounding sphere of the
+// mesh on screen, or -1 for the mesh itself.  The sphere is placed by the same transformations as the mesh.
+int OpenGLWindow::SelectLod() {
+    if (!m_mesh || m_lods.empty() || !m_use_lods) return -1;
+    static float pi = acos(-1.);
+    const float scale = m_normalize_size ? NormalizeScale() : 1.f;
+    const glm::vec3 bmin(m_bounding_box.xmin, m_bounding_box.ymin, m_bounding_box.zmin);
+    const glm::vec3 bmax(m_bounding_box.xmax, m_bounding_box.ymax, m_bounding_box.zmax);
+    const float radius = scale * 0.5f * glm::length(bmax - bmin);
+    const glm::vec4 center = MeshModelView() * glm::vec4(0.5f * (bmin + bmax), 1.f);
+    float half_height;     // of the view at the depth of the center
+    if (m_projection == Ortho) {
+        half_height = m_camera.distance * tan(kFov/2./180.*pi) * sqrt(3.);  // as in Project
+    } else {
+        const float depth = -center.z;
+        if (depth <= radius) return -1;     // the camera is inside the sphere
+        half_height = depth * tan(kFov/2./180.*pi);
+    }
+    const float radius_px = radius / half_height * 0.5f * float(this->height());
+    const float faces = kLodFacesPerPixel * pi * radius_px * radius_px;
+    for (int i = int(m_lods.size()) - 1; i >= 0; --i) {
+        if (float(m_lods[i]->NumFaces()) >= faces) return i;
+    }
+    return -1;
+}
+
+// The picked face filled on top of the mesh, its nearest side and corner in front of everything.
+void OpenGLWindow::DrawPicked(bool bv) {
+    if (bv && m_mesh && m_picked.face >= 0) {
+        const std::vector<int> &tri = m_mesh->GetTriangles();
+        glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_LINE_BIT | GL_POINT_BIT | GL_POLYGON_BIT);
+        glDisable(GL_LIGHTING);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(-1.f, -1.f);
+        glColor3f(1.0f, 0.8f, 0.0f);
+        glBegin(GL_TRIANGLES);
+        for (int c = 0; c < 3; ++c) {
+            const HE_vert *v = m_mesh->GetVertex(tri[3 * m_picked.face + c]);
+            glVertex3f(v->x, v->y, v->z);
+        }
+        glEnd();
+        glDisable(GL_DEPTH_TEST);
+        glColor3f(1.0f, 0.2f, 0.2f);
+        glLineWidth(4.);
+        glBegin(GL_LINES);
+        for (int end = 0; end < 2; ++end) {
+            const HE_vert *v = m_mesh->GetVertex(m_picked.edge[end]);
+            glVertex3f(v->x, v->y, v->z);
+        }
+        glEnd();
+        glColor3f(0.2f, 0.4f, 1.0f);
+        glPointSize(10.);
+        glBegin(GL_POINTS);
+        const HE_vert *v = m_mesh->GetVertex(m_picked.vertex);
+        glVertex3f(v->x, v->y, v->z);
+        glEnd();
+        glPopAttrib();
+    }
+}
+
+// Cast the ray under the pixel (x, y) into m_bvh.  It runs from the near to the far plane, both taken back to
+// the mesh by the inverse of the matrices the mesh is drawn with, so that either projection works.
+// Of the hit face, the corner and the side nearest to the hit point are picked along with it.
+void OpenGLWindow::Pick(int x, int y) {
+    if (!m_mesh) return;
+    if (!m_bvh) {
+        emit(operatorInfo(QString("Nothing to pick until the BVH of the mesh is built.")));
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const glm::mat4 inverse = glm::inverse(m_projection_matrix * MeshModelView());
+    const float ndc_x = 2.f * (float(x) + 0.5f) / float(this->width()) - 1.f;
+    const float ndc_y = 1.f - 2.f * (float(y) + 0.5f) / float(this->height());
+    glm::vec4 near_point = inverse * glm::vec4(ndc_x, ndc_y, -1.f, 1.f);
+    glm::vec4 far_point = inverse * glm::vec4(ndc_x, ndc_y, 1.f, 1.f);
+    near_point /= near_point.w;
+    far_point /= far_point.w;
+    const float origin[3] = {near_point.x, near_point.y, near_point.z};
+    const float dir[3] = {far_point.x - near_point.x, far_point.y - near_point.y, far_point.z - near_point.z};
+    BVH::RayHit hit;
+    m_picked.face = -1;
+    if (!m_bvh->Intersect(origin, dir, hit, 1.f)) {
+        emit(operatorInfo(QString("Nothing picked.")));
+        return;
+    }
+
+    const std::vector<int> &tri = m_mesh->GetTriangles();
+    const int *corners = &tri[3 * hit.face];
+    glm::vec3 p[3];
+    for (int c = 0; c < 3; ++c) {
+        const HE_vert *v = m_mesh->GetVertex(corners[c]);
+        p[c] = glm::vec3(v->x, v->y, v->z);
+    }
+    m_picked.face = hit.face;
+    m_picked.bary[0] = 1.f - hit.u - hit.v;
+    m_picked.bary[1] = hit.u;
+    m_picked.bary[2] = hit.v;
+    const glm::vec3 point = m_picked.bary[0] * p[0] + m_picked.bary[1] * p[1] + m_picked.bary[2] * p[2];
+    float vertex_distance = FLT_MAX, edge_distance = FLT_MAX;
+    for (int c = 0; c < 3; ++c) {
+        const float d = glm::length(point - p[c]);
+        if (d < vertex_distance) {
+            vertex_distance = d;
+            m_picked.vertex = corners[c];
+        }
+        const glm::vec3 side = p[(c + 1) % 3] - p[c];
+        const float along = glm::dot(side, side) > 0.f ? glm::dot(point - p[c], side) / glm::dot(side, side) : 0.f;
+        const float e = glm::length(point - (p[c] + MIN(MAX(along, 0.f), 1.f) * side));
+        if (e < edge_distance) {
+            edge_distance = e;
+            m_picked.edge[0] = corners[c];
+            m_picked.edge[1] = corners[(c + 1) % 3];
+        }
+    }
+    const double ms = timer.nsecsElapsed() * 1e-6;
+    emit(operatorInfo(QString("Picked face %1, vertex %2, edge %3-%4, barycentric (%5, %6, %7) in %8 ms")
+                      .arg(m_mesh->GetFace(hit.face)->id).arg(m_mesh->GetVertex(m_picked.vertex)->id)
+                      .arg(m_mesh->GetVertex(m_picked.edge[0])->id).arg(m_mesh->GetVertex(m_picked.edge[1])->id)
+                      .arg(m_picked.bary[0], 0, 'f', 3).arg(m_picked.bary[1], 0, 'f', 3)
+                      .arg(m_picked.bary[2], 0, 'f', 3).arg(ms, 0, 'f', 3)));
+}
+
+// Ranges of the BVH face order whose boxes are in the view frustum, into m_visible_faces.  Return false
+// if m_buffers does not draw m_mesh in that order, or culling is off.
+bool OpenGLWindow::CullFaces() {
+    if (!m_frustum_culling || !m_bvh || m_lod >= 0) return false;
+    float planes[6][4];
+    BVH::FrustumPlanes(glm::value_ptr(m_projection_matrix * MeshModelView()), planes);
+    m_num_visible_faces = long(m_bvh->CullFrustum(planes, m_visible_faces));
+    return true;
+}
+
+// The modelview matrix the mesh is drawn with, see paintGL and Render.  NormalizeSize amounts to scaling
+// about the origin.
+glm::mat4 OpenGLWindow::MeshModelView() {
+    glm::mat4 modelview = m_camera.LookAt() * m_arcball.GetMatrix();
+    if (m_normalize_size && m_mesh) modelview = glm::scale(modelview, glm::vec3(NormalizeScale()));
+    return modelview;
+}
+
+// The scale applied by NormalizeSize.
+float OpenGLWindow::NormalizeScale() const {
+    float x = m_bounding_box.xmax - m_bounding_box.xmin;
+    float y = m_bounding_box.ymax - m_bounding_box.ymin;
+    float z = m_bounding_box.zmax - m_bounding_box.zmin;
+    return 1.f/MIN(x, MIN(y, z));
+}
+
 void OpenGLWindow::NormalizeSize(bool bv) {
     if (bv && m_mesh) {
         float ctr_x = (m_bounding_box.xmin + m_bounding_box.xmax)/2;
         float ctr_y = (m_bounding_box.ymin + m_bounding_box.ymax)/2;
         float ctr_z = (m_bounding_box.zmin + m_bounding_box.zmax)/2;
-        float x = m_bounding_box.xmax - m_bounding_box.xmin;
-        float y = m_bounding_box.ymax - m_bounding_box.ymin;
-        float z = m_bounding_box.zmax - m_bounding_box.zmin;
-        float scale = 1.f/MIN(x, MIN(y, z));
+        float scale = NormalizeScale();
         glTranslatef(scale*ctr_x, scale*ctr_y, scale*ctr_z);
         glScalef(scale, scale, scale);
         glTranslatef(-ctr_x, -ctr_y, -ctr_z);
@@ -416,50 +735,40 @@ void OpenGLWindow::NormalizeSize(bool bv) {
 
 void OpenGLWindow::Project() {
     static float pi = acos(-1.);
-    static float fov = 45.0;
+    static float fov = kFov;
     static float len = tan(fov/2./180.*pi)*sqrt(3.); // Heuristics since init location is (1,1,1).
     float ar = float(this->width()) / float(this->height()); // aspect ratio
+    glm::mat4 Projection;
     if (m_projection == Ortho) {
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
         // Adjust viewing window to zoom in/out.
-        glOrtho(-m_camera.distance*len*ar, m_camera.distance*len*ar,
-                -m_camera.distance*len, m_camera.distance*len,
-                0.01, 100.);
+        Projection = glm::ortho(-m_camera.distance*len*ar, m_camera.distance*len*ar,
+                                -m_camera.distance*len, m_camera.distance*len,
+                                0.01f, 100.f);
     } else {
-        glm::mat4 Projection = glm::perspective(glm::radians(fov),
+        Projection = glm::perspective(glm::radians(fov),
             GLfloat(ar), 0.01f, 100.0f);
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glLoadMatrixf(glm::value_ptr(Projection));
     }
+    m_projection_matrix = Projection;
+    m_gl_state.Projection(glm::value_ptr(Projection));   // only loaded when it has changed
 }
 
 void OpenGLWindow::Shade() {
-    glShadeModel(m_shade==Smooth?GL_SMOOTH:GL_FLAT);
+    m_gl_state.ShadeModel(m_shade==Smooth?GL_SMOOTH:GL_FLAT);
 }
 
 // helper func
 
+// The mesh keeps its bounding box up to date while vertices move, see TriMesh::MarkDirty.
 void OpenGLWindow::ComputeBoundingBox() {
     if (!m_mesh) return;
-    m_bounding_box.xmin = m_bounding_box.xmax =
-    m_bounding_box.ymin = m_bounding_box.ymax =
-    m_bounding_box.zmin = m_bounding_box.zmax = 0.;
-    for (auto vit = m_mesh->GetVerticesBegin(); vit != m_mesh->GetVerticesEnd(); ++vit) {
-        if ((*vit)->x > m_bounding_box.xmax)
-            m_bounding_box.xmax = (*vit)->x;
-        if ((*vit)->x < m_bounding_box.xmin)
-            m_bounding_box.xmin = (*vit)->x;
-        if ((*vit)->y > m_bounding_box.ymax)
-            m_bounding_box.ymax = (*vit)->y;
-        if ((*vit)->y < m_bounding_box.ymin)
-            m_bounding_box.ymin = (*vit)->y;
-        if ((*vit)->z > m_bounding_box.zmax)
-            m_bounding_box.zmax = (*vit)->z;
-        if ((*vit)->z < m_bounding_box.zmin)
-            m_bounding_box.zmin = (*vit)->z;
-    }
+    float bmin[3], bmax[3];
+    m_mesh->GetBoundingBox(bmin, bmax);
+    m_bounding_box.xmin = bmin[0];
+    m_bounding_box.xmax = bmax[0];
+    m_bounding_box.ymin = bmin[1];
+    m_bounding_box.ymax = bmax[1];
+    m_bounding_box.zmin = bmin[2];
+    m_bounding_box.zmax = bmax[2];
 }
 
 void OpenGLWindow::PrintMeshInfo(const QString &filename = "") {
@@ -2,10 +2,19 @@
 #define OPENGLWINDOW_H
 #include <GL/glew.h>
 #include <QGLWidget>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "arcball.h"
+#include "meshloader.h"
+#include "meshbuffers.h"
+#include "decorationbuffer.h"
+#include "glstatecache.h"
+#include "frameprofiler.h"
+#include "adaptivequality.h"
 #include <vector>
 #include <math.h>
 #include <unordered_map>
@@ -77,7 +86,7 @@ class OpenGLWindow : public QGLWidget
     };
 
 
-    // Draw a cone with base on the x-y plane and apex at the z-coord.
+    // A cone with base on the x-y plane and apex at the z-coord.
     struct Cone {
         float h;     // height
         float r;     // radius
@@ -94,19 +103,21 @@ class OpenGLWindow : public QGLWidget
             e.push_back(e.front()); // Push the last triangle.
         }
 
-        void Draw() { // All we need to do is to calculate the coords of the base points.
+        // Triangles of the side and of the base, placed by `m`.
+        void Triangulate(const glm::mat4 &m, std::vector<glm::vec3> &out) const {
             assert(e.size() == size_t(n+1));
-            glBegin(GL_TRIANGLE_FAN);
-            glVertex3f(0., 0., h);
-            for (int i = 0; i != n+1; ++i) {
-                glVertex3f(e[i].x, e[i].y, e[i].z);
-            }
-            glEnd();
-            glBegin(GL_POLYGON);
+            auto place = [&m](const glm::vec3 &p) { return glm::vec3(m * glm::vec4(p, 1.f)); };
+            const glm::vec3 apex(0., 0., h);
             for (int i = 0; i != n; ++i) {
-                glVertex3f(e[i].x, e[i].y, e[i].z);
+                out.push_back(place(apex));
+                out.push_back(place(e[i]));
+                out.push_back(place(e[i+1]));
+            }
+            for (int i = 1; i + 1 < n; ++i) {
+                out.push_back(place(e[0]));
+                out.push_back(place(e[i]));
+                out.push_back(place(e[i+1]));
             }
-            glEnd();
         }
     };
 
@@ -131,35 +142,72 @@ protected:
 private:
     void Render();      // Main func doing the dirty job
     void SetLight();
+    void BuildAxes();
     void DrawAxes(bool);
     void DrawPoints(bool);
+    void DrawPointSubset(bool, int step);
     void DrawEdges(bool);
     void DrawFaces(bool);
     void DrawTexture(bool);
     void DrawBoundingBox(bool);
+    void DrawPicked(bool);
+    void Pick(int x, int y);
     void NormalizeSize(bool);
     void Project();
     void Shade();
+    void DrawHud(bool);
+    void Interact();
+    void AdaptQuality();
+    int SelectLod();
+    bool CullFaces();
+    glm::mat4 MeshModelView();
+    TriMesh &DrawnMesh() { return m_lod < 0 ? *m_mesh : *m_lods[m_lod]; }
+    MeshBuffers &DrawnBuffers() { return m_lod < 0 ? m_buffers : m_lod_buffers[m_lod]; }
+    float NormalizeScale() const;
+    // Whether m_mesh may be modified now, e.g. through TriMesh::SetVertexPosition.
+    bool CanEditMesh() const { return m_mesh && !m_mesh_shared; }
 
 public slots:
+    // Schedule a repaint with the latest state.  Requests are coalesced: at most one frame is drawn
+    // per display refresh, no matter how many arrive in between.
+    void RequestRepaint();
     void ReadMesh();
-    void SetDrawPoints(bool b) {m_draw_points = b; updateGL();}
-    void SetDrawEdges(bool b) {m_draw_edges = b; updateGL();}
-    void SetDrawFaces(bool b) {m_draw_faces = b; updateGL(); }
-    void SetDrawAxes(bool b) {m_draw_axes = b; updateGL();}
-    void SetDrawBoundingBox(bool b) {m_draw_bounding_box = b; updateGL();}
-    void SetDrawLighting(bool b) {m_lighting = b; updateGL();}
-    void SetNormalized(bool b) {m_normalize_size = b; updateGL();}
-    void SetProjectionMode(int p) {m_projection = (p==0?Persp:Ortho); updateGL();}
-    void SetShadeMode(int s) {m_shade = (s==0?Smooth:Flat); updateGL();}
-    void SetRollSpeed(double s) {m_roll_speed = s; updateGL();}
-    void SetMaterial(const QString &s) {m_material_name  = s.toStdString(); updateGL();}
-    void SetLightIntensity(double l) {m_light_intensity = float(l); updateGL();}
+    void CancelLoading();
+    void SetDrawPoints(bool b) {m_draw_points = b; RequestRepaint();}
+    void SetDrawEdges(bool b) {m_draw_edges = b; RequestRepaint();}
+    void SetDrawBoundary(bool b) {m_draw_boundary = b; RequestRepaint();}
+    void SetDrawFaces(bool b) {m_draw_faces = b; RequestRepaint();}
+    void SetDrawAxes(bool b) {m_draw_axes = b; RequestRepaint();}
+    void SetDrawBoundingBox(bool b) {m_draw_bounding_box = b; RequestRepaint();}
+    void SetDrawHud(bool b) {m_draw_hud = b; RequestRepaint();}
+    void SetDrawLighting(bool b) {m_lighting = b; RequestRepaint();}
+    void SetNormalized(bool b) {m_normalize_size = b; RequestRepaint();}
+    void SetProjectionMode(int p) {m_projection = (p==0?Persp:Ortho); RequestRepaint();}
+    void SetShadeMode(int s) {m_shade = (s==0?Smooth:Flat); RequestRepaint();}
+    void SetRollSpeed(double s) {m_roll_speed = s; RequestRepaint();}
+    void SetMaterial(const QString &s) {m_material_name  = s.toStdString(); RequestRepaint();}
+    void SetLightIntensity(double l) {m_light_intensity = float(l); RequestRepaint();}
+    void SetAdaptiveQuality(bool b) {m_quality.SetEnabled(b); RequestRepaint();}
+    void SetIdleTimeout(int ms) {m_idle_timer.setInterval(ms);}
+    void SetUseLods(bool b) {m_use_lods = b; RequestRepaint();}
+    void SetFrustumCulling(bool b) {m_frustum_culling = b; RequestRepaint();}
 
 
 signals:
     void operatorInfo(QString); // a simple signal hoding information.
                                 // probably for logging
+    void loadStateChanged(bool);    // whether a mesh is being loaded in the background
+    void loadProgress(int);         // percentage of the current load
+    void requestLoad(QString, int); // forwarded to the loader thread
+
+private slots:
+    void OnLoadProgress(int percent, int request);
+    void OnMeshLoaded(TriMeshPtr mesh, QString filename, int request);
+    void OnBvhReady(BVHPtr bvh, int request);
+    void OnLodsReady(TriMeshList lods, int request);
+    void OnMeshReleased(int request);
+    void OnLoadFailed(QString reason, int request);
+    void OnIdle();
 
 private: // helper func
     void ComputeBoundingBox();
@@ -167,23 +215,70 @@ private: // helper func
 
 private:
     std::shared_ptr<TriMesh> m_mesh;
+    MeshBuffers m_buffers;  // m_mesh on the GPU, brought up to date at the start of every frame
+    // BVH over the faces of m_mesh, built by the loader after the mesh is shown and refit when it is edited.
+    // m_buffers stores the triangles in the face order of the BVH, so the faces in the view are ranges of them.
+    BVHPtr m_bvh;
+    bool m_frustum_culling;
+    std::vector<std::pair<int, int>> m_visible_faces;   // ranges of the BVH face order, see CullFaces
+    long m_num_visible_faces;   // drawn in the current frame, -1 if not culled
+    // Element of m_mesh under the last right click, see Pick.  Corners are in the order of the corner table.
+    struct {
+        int face;           // position in the face list, -1 for none
+        int vertex;         // position in the vertex list of the corner nearest to the hit point
+        int edge[2];        // corners at the ends of the side nearest to the hit point
+        float bary[3];      // barycentric coordinates of the hit point
+    } m_picked;
+    // Levels of detail of m_mesh, finest first, built by the loader after the mesh is shown.  They are not
+    // updated when m_mesh is edited.
+    TriMeshList m_lods;
+    std::vector<MeshBuffers> m_lod_buffers;     // one per level, uploaded on first use
+    bool m_use_lods;
+    int m_lod;              // level drawn in the current frame, -1 for m_mesh, see SelectLod
+    DecorationBuffer m_axes;    // axes, their cones and the ground grid, built on first use
     Camera m_camera;
     ArcBall m_arcball;
     bool m_draw_axes;
     bool m_draw_points;
     bool m_draw_edges;
+    bool m_draw_boundary;   // highlight boundary edges along with the edges
     bool m_draw_faces;
     bool m_draw_texture;
     bool m_draw_bounding_box;
     bool m_lighting;
     bool m_normalize_size;
     ProjMode m_projection;
+    glm::mat4 m_projection_matrix;  // loaded by Project
     ShadeMode m_shade;
     double m_roll_speed;
     struct {float xmin, xmax, ymin, ymax, zmin, zmax;} m_bounding_box;
     std::string m_material_name;
     std::unordered_map<std::string, Material> m_materials;
     float m_light_intensity;
+    GLStateCache m_gl_state;    // all state set per frame goes through it, see GLStateCache
+    bool m_print_gl_stats;      // print the issued/skipped state calls of every frame (MESHVIEWER_GL_STATS)
+    FrameProfiler m_profiler;   // logged to the CSV file named by MESHVIEWER_FRAME_LOG, if set
+    bool m_draw_hud;            // frame times on screen
+
+    // Repaint pacing, see RequestRepaint.
+    QTimer m_repaint_timer;     // single shot, running while a repaint is pending
+    QElapsedTimer m_last_frame; // since the start of the last paintGL
+    int m_frame_interval_ms;    // of the display refresh
+
+    // Reduced detail while the view is dragged, full quality once input has stopped for the idle timeout.
+    // The target frame time is the refresh interval unless MESHVIEWER_TARGET_FPS is set.
+    AdaptiveQuality m_quality;
+    QTimer m_idle_timer;        // single shot, restarted by every interactive input event
+
+    // Background loading.  A new mesh only replaces m_mesh once it is completely built.
+    QThread m_loader_thread;
+    MeshLoader *m_loader;   // lives on m_loader_thread
+    int m_load_request;     // id of the latest load request
+    bool m_loading;
+    // The loader still reads m_mesh for its BVH and levels of detail, see MeshLoader::released.  Until then
+    // m_mesh must not be edited, and vertices marked dirty are not refreshed.
+    int m_mesh_request;     // the request m_mesh was loaded by
+    bool m_mesh_shared;
 };
 
 #endif // OPENGLWINDOW_H
@@ -0,0 +1,87 @@
+//
+// Edge ids are owned by each mesh: building meshes on several threads at once must give every mesh
+// the ids 0..NumEdges()-1, in m_edges order, whatever the other meshes do.
+//
+
+#include "TriMesh.h"
+#include <memory>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+
+// A torus of rows x cols quads, each split into two triangles.  Closed, so no boundary edges.
+static std::shared_ptr<TriMesh> MakeTorus(int rows, int cols) {
+    auto mesh = std::make_shared<TriMesh>();
+    mesh->Reserve(std::size_t(rows) * cols, 2 * std::size_t(rows) * cols);
+    for (int i = 0; i < rows; ++i) {
+        const float u = 2.f * float(M_PI) * i / rows;
+        for (int j = 0; j < cols; ++j) {
+            const float w = 2.f * float(M_PI) * j / cols;
+            mesh->InsertVertex((2.f + cosf(w)) * cosf(u), (2.f + cosf(w)) * sinf(u), sinf(w), i * cols + j);
+        }
+    }
+    auto vid = [&](int i, int j) { return (i % rows) * cols + j % cols; };
+    int fid = 0;
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            mesh->InsertFace(fid++, vid(i, j), vid(i + 1, j), vid(i + 1, j + 1));
+            mesh->InsertFace(fid++, vid(i, j), vid(i + 1, j + 1), vid(i, j + 1));
+        }
+    }
+    mesh->Update();
+    return mesh;
+}
+
+// Whether the edge ids of `mesh` are exactly 0..NumEdges()-1 in m_edges order.
+static bool DenseEdgeIds(TriMesh &mesh) {
+    int expected = 0;
+    for (auto it = mesh.GetEdgesBegin(); it != mesh.GetEdgesEnd(); ++it, ++expected) {
+        if ((*it)->id != expected) {
+            printf("test_edge_ids: edge %d has id %d.\n", expected, (*it)->id);
+            return false;
+        }
+    }
+    return expected == int(mesh.NumEdges());
+}
+
+int main() {
+    const int num_meshes = 8;
+    // Built one after the other, these are the ids every mesh must end up with.
+    std::vector<std::vector<int>> reference(num_meshes);
+    for (int k = 0; k < num_meshes; ++k) {
+        auto mesh = MakeTorus(40 + 10 * k, 30 + 5 * k);
+        for (auto it = mesh->GetEdgesBegin(); it != mesh->GetEdgesEnd(); ++it) reference[k].push_back((*it)->id);
+    }
+
+    std::vector<std::shared_ptr<TriMesh>> meshes(num_meshes);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < num_meshes; ++k) {
+        threads.emplace_back([&meshes, k]() { meshes[k] = MakeTorus(40 + 10 * k, 30 + 5 * k); });
+    }
+    for (auto &t : threads) t.join();
+
+    int failures = 0;
+    for (int k = 0; k < num_meshes; ++k) {
+        TriMesh &mesh = *meshes[k];
+        // a closed mesh has three half-edges per face
+        if (mesh.NumEdges() != 3 * mesh.NumFaces()) {
+            printf("test_edge_ids: mesh %d has %d edges for %d faces.\n", k, int(mesh.NumEdges()), int(mesh.NumFaces()));
+            ++failures;
+            continue;
+        }
+        if (!DenseEdgeIds(mesh)) {
+            printf("test_edge_ids: mesh %d does not have dense edge ids.\n", k);
+            ++failures;
+            continue;
+        }
+        std::vector<int> ids;
+        for (auto it = mesh.GetEdgesBegin(); it != mesh.GetEdgesEnd(); ++it) ids.push_back((*it)->id);
+        if (ids != reference[k]) {
+            printf("test_edge_ids: mesh %d got other ids than when built alone.\n", k);
+            ++failures;
+        }
+    }
+    printf("test_edge_ids: %d of %d meshes passed.\n", num_meshes - failures, num_meshes);
+    return failures == 0 ? 0 : 1;
+}
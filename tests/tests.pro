@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Tests of the mesh library.  They only need the headers of the parent directory.
+# Build with qmake and run with `make check`.
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+CONFIG += console c++17 testcase
+CONFIG -= app_bundle qt
+
+TARGET = test_edge_ids
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += test_edge_ids.cpp
+
+LIBS += -lpthread